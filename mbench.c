@@ -0,0 +1,370 @@
+/*
+ * mbench -- microbenchmarks of the allocator primitives.
+ *
+ * Each benchmark lays out the heap so that one call goes down a known path
+ * (a cache hit, a split free block, one of the four coalescing cases, a
+ * realloc in place or a move, a heap extension), then times that call alone.
+ * The search, placement and coalescing code is static in mm.c, so it is
+ * reached through the public functions. Timer overhead is measured once and
+ * subtracted from every sample.
+ *
+ * The malloc/free pairs run with the default options. The later benchmarks
+ * turn off the thread cache, trimming and purging, which would otherwise
+ * take the timed call off the path it is meant to measure.
+ *
+ * Build:
+ *     cc -O2 mbench.c mm.c memlib.c -o mbench
+ * Usage:
+ *     ./mbench [-n iterations] [name_filter]
+ */
+#include "mm.h"
+#include "memlib.h"
+
+#include <stdint.h>  // uint64_t
+#include <stdio.h>   // printf, fprintf
+#include <stdlib.h>  // qsort, malloc, exit
+#include <string.h>  // strstr
+#include <time.h>    // clock_gettime
+#include <unistd.h>  // getopt
+
+#define HEAP_SIZE 1024  // bytes of the heap blocks used by the primitives
+
+typedef struct {
+    uint64_t *ns;  // one sample per timed call
+    int count;
+} Samples;
+
+static int iterations = 100000;
+static uint64_t timer_overhead;
+
+static uint64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+/**
+ * Records the time elapsed since `start`, less the cost of reading the clock
+ */
+static void record(Samples *s, uint64_t start) {
+    uint64_t ns = now_ns() - start;
+    s->ns[s->count++] = ns > timer_overhead ? ns - timer_overhead : 0;
+}
+
+/**
+ * Starts a benchmark on an empty heap
+ */
+static void reset_heap(void) {
+    mem_reset_brk();
+    if (mm_init() < 0) {
+        fprintf(stderr, "mbench: mm_init failed\n");
+        exit(1);
+    }
+}
+
+static void *xmalloc(size_t size) {
+    void *ptr = mm_malloc(size);
+    if (ptr == NULL) {
+        fprintf(stderr, "mbench: out of memory\n");
+        exit(1);
+    }
+    return ptr;
+}
+
+static int compare_address(const void *a, const void *b) {
+    uintptr_t x = (uintptr_t)*(void *const *)a, y = (uintptr_t)*(void *const *)b;
+    return x < y ? -1 : x > y;
+}
+
+/**
+ * Allocates blocks of HEAP_SIZE bytes, in address order. Blocks placed one
+ * after the other are neighbors, whichever end of a free block they come from
+ */
+static void alloc_sorted(void **blocks, int count) {
+    for (int k = 0; k < count; k++)
+        blocks[k] = xmalloc(HEAP_SIZE);
+    qsort(blocks, count, sizeof(void *), compare_address);
+}
+
+/**
+ * Stops a benchmark whose heap layout is not the one it measures
+ */
+static void layout_failed(const char *benchmark) {
+    fprintf(stderr, "mbench: %s: unexpected heap layout\n", benchmark);
+    exit(1);
+}
+
+#ifndef NDEBUG
+/* Blocks expected one after the other in a heap walk */
+typedef struct {
+    void **blocks;
+    int count;
+    int matched;  // blocks found so far, in order
+} Neighbors;
+
+static int visit_neighbors(void *payload, size_t size, int allocated, void *arg) {
+    Neighbors *n = arg;
+    (void)size, (void)allocated;
+    if (n->matched < n->count && payload == n->blocks[n->matched])
+        n->matched++;
+    else if (n->matched > 0 && n->matched < n->count)
+        return 1;  // a block in between
+    return 0;
+}
+#endif
+
+/**
+ * Checks that blocks sorted by address are neighbors in the heap, with
+ * mm_heap_walk; builds with -DNDEBUG skip the check
+ */
+static void check_neighbors(const char *benchmark, void **blocks, int count) {
+#ifndef NDEBUG
+    Neighbors n = { blocks, count, 0 };
+    mm_heap_walk(visit_neighbors, &n);
+    if (n.matched != count)
+        layout_failed(benchmark);
+#else
+    (void)benchmark, (void)blocks, (void)count;
+#endif
+}
+
+/**
+ * A malloc immediately freed: the hot path of each size class
+ */
+static void bench_pair(Samples *s, size_t size) {
+    reset_heap();
+    mm_free(xmalloc(size));  // warm up: runs, caches and chunks exist
+    for (int i = 0; i < iterations; i++) {
+        uint64_t start = now_ns();
+        void *ptr = mm_malloc(size);
+        mm_free(ptr);
+        record(s, start);
+    }
+}
+
+/**
+ * A malloc and free of a random size in a heap of scattered free blocks, so
+ * the search has to find a fit among many candidates
+ */
+static void bench_fragmented(Samples *s, size_t size) {
+    enum { BLOCKS = 20000 };
+    static void *blocks[BLOCKS];
+    unsigned seed = 2463534242u;
+    (void)size;
+
+    reset_heap();
+    for (int k = 0; k < BLOCKS; k++) {
+        seed ^= seed << 13, seed ^= seed >> 17, seed ^= seed << 5;
+        blocks[k] = xmalloc(64 + seed % 4096);
+    }
+    for (int k = 0; k < BLOCKS; k += 2)
+        mm_free(blocks[k]);
+    for (int i = 0; i < iterations; i++) {
+        seed ^= seed << 13, seed ^= seed >> 17, seed ^= seed << 5;
+        size_t request = 64 + seed % 4096;
+        uint64_t start = now_ns();
+        void *ptr = mm_malloc(request);
+        mm_free(ptr);
+        record(s, start);
+    }
+    for (int k = 1; k < BLOCKS; k += 2)
+        mm_free(blocks[k]);
+}
+
+/**
+ * Frees a block between two neighbors, named by address
+ * @param size - bit 0 set: the previous neighbor is free, bit 1: the next one
+ */
+static void bench_coalesce(Samples *s, size_t size) {
+    static const char *names[] = { "coalesce/none", "coalesce/prev", "coalesce/next",
+                                   "coalesce/both" };
+    int prev_free = size & 1, next_free = size >> 1 & 1;
+
+    reset_heap();
+    for (int i = 0; i < iterations; i++) {
+        // guards keep the free neighbors from merging any further
+        void *blocks[5];
+        alloc_sorted(blocks, 5);
+        check_neighbors(names[size], blocks, 5);
+        void *guard = blocks[0], *prev = blocks[1], *block = blocks[2];
+        void *next = blocks[3], *guard2 = blocks[4];
+        if (prev_free)
+            mm_free(prev);
+        if (next_free)
+            mm_free(next);
+        uint64_t start = now_ns();
+        mm_free(block);
+        record(s, start);
+        if (!prev_free)
+            mm_free(prev);
+        if (!next_free)
+            mm_free(next);
+        mm_free(guard);
+        mm_free(guard2);
+    }
+}
+
+/**
+ * Grows a block into the free block after it
+ */
+static void bench_realloc_in_place(Samples *s, size_t size) {
+    (void)size;
+    reset_heap();
+    for (int i = 0; i < iterations; i++) {
+        void *blocks[3];
+        alloc_sorted(blocks, 3);
+        void *ptr = blocks[0], *next = blocks[1], *guard = blocks[2];
+        mm_free(next);  // enough room to double ptr
+        uint64_t start = now_ns();
+        void *grown = mm_realloc(ptr, 2 * HEAP_SIZE);
+        record(s, start);
+        if (grown != ptr)
+            layout_failed("realloc/in_place");
+        mm_free(grown);
+        mm_free(guard);
+    }
+}
+
+/**
+ * Grows a block whose next neighbor is allocated, so it has to move
+ */
+static void bench_realloc_move(Samples *s, size_t size) {
+    (void)size;
+    reset_heap();
+    for (int i = 0; i < iterations; i++) {
+        void *blocks[2];
+        alloc_sorted(blocks, 2);
+        void *ptr = blocks[0], *guard = blocks[1];
+        uint64_t start = now_ns();
+        void *moved = mm_realloc(ptr, 2 * HEAP_SIZE);
+        record(s, start);
+        if (moved == ptr || moved == NULL)
+            layout_failed("realloc/move");
+        mm_free(moved);
+        mm_free(guard);
+    }
+}
+
+/**
+ * Allocates with no free block left, so every call extends the heap
+ */
+static void bench_extend(Samples *s, size_t size) {
+    enum { ROUND = 1024 };  // extensions before the heap starts over
+    static void *blocks[ROUND];
+
+    for (int i = 0; i < iterations; i++) {
+        if (i % ROUND == 0)
+            reset_heap();
+        uint64_t start = now_ns();
+        blocks[i % ROUND] = mm_malloc(size);
+        record(s, start);
+        if (blocks[i % ROUND] == NULL) {
+            fprintf(stderr, "mbench: out of memory\n");
+            exit(1);
+        }
+    }
+}
+
+static const struct {
+    const char *name;
+    void (*run)(Samples *s, size_t size);
+    size_t size;
+    int isolated;  // runs without thread cache, trimming or purging
+} benchmarks[] = {
+    { "pair/16",             bench_pair,             16,         0 },
+    { "pair/48",             bench_pair,             48,         0 },
+    { "pair/128",            bench_pair,             128,        0 },
+    { "pair/256",            bench_pair,             256,        0 },
+    { "pair/1024",           bench_pair,             1024,       0 },
+    { "pair/4096",           bench_pair,             4096,       0 },
+    { "pair/65536",          bench_pair,             65536,      0 },
+    { "pair/1048576",        bench_pair,             1048576,    0 },
+    { "fragmented",          bench_fragmented,       0,          1 },
+    { "coalesce/none",       bench_coalesce,         0,          1 },
+    { "coalesce/prev",       bench_coalesce,         1,          1 },
+    { "coalesce/next",       bench_coalesce,         2,          1 },
+    { "coalesce/both",       bench_coalesce,         3,          1 },
+    { "realloc/in_place",    bench_realloc_in_place, 0,          1 },
+    { "realloc/move",        bench_realloc_move,     0,          1 },
+    { "extend/4096",         bench_extend,           4096,       1 },
+    { "extend/65536",        bench_extend,           65536,      1 },
+};
+
+static int compare(const void *a, const void *b) {
+    uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+    return x < y ? -1 : x > y;
+}
+
+/**
+ * @return the smallest sample with at least a fraction `p` of the sorted
+ *         samples at or below it
+ */
+static uint64_t percentile(Samples *s, double p) {
+    double exact = p * s->count;
+    int rank = (int)exact;
+    if (rank < exact)
+        rank++;  // ceil(p * count), from 1
+    rank = rank < 1 ? 1 : rank < s->count ? rank : s->count;
+    return s->ns[rank - 1];
+}
+
+/**
+ * Measures the median cost of reading the clock twice
+ */
+static void calibrate(Samples *s) {
+    s->count = 0;
+    for (int i = 0; i < iterations; i++)
+        record(s, now_ns());
+    qsort(s->ns, s->count, sizeof(uint64_t), compare);
+    timer_overhead = percentile(s, 0.5);
+}
+
+int main(int argc, char **argv) {
+    const char *filter = NULL;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "n:")) != -1) {
+        if (opt == 'n' && atoi(optarg) > 0) {
+            iterations = atoi(optarg);
+        } else {
+            fprintf(stderr, "usage: %s [-n iterations] [name_filter]\n", argv[0]);
+            exit(1);
+        }
+    }
+    if (optind < argc)
+        filter = argv[optind];
+
+    Samples s;
+    s.ns = malloc(iterations * sizeof(uint64_t));
+    if (s.ns == NULL) {
+        fprintf(stderr, "mbench: out of memory\n");
+        exit(1);
+    }
+    mem_init();
+    calibrate(&s);
+    printf("%-20s %8s %8s %8s %8s %8s   (ns, timer overhead %llu ns removed)\n",
+           "benchmark", "mean", "p50", "p90", "p99", "p99.9", (unsigned long long)timer_overhead);
+    for (size_t b = 0; b < sizeof(benchmarks) / sizeof(benchmarks[0]); b++) {
+        if (filter != NULL && strstr(benchmarks[b].name, filter) == NULL)
+            continue;
+        if (benchmarks[b].isolated) {
+            // isolated benchmarks come last, these options stay
+            mm_setopt(MM_OPT_TCACHE, 0);
+            mm_setopt(MM_OPT_TRIM_THRESHOLD, 0);
+            mm_setopt(MM_OPT_DECAY_MS, -1);
+        }
+        s.count = 0;
+        benchmarks[b].run(&s, benchmarks[b].size);
+        uint64_t total = 0;
+        for (int i = 0; i < s.count; i++)
+            total += s.ns[i];
+        qsort(s.ns, s.count, sizeof(uint64_t), compare);
+        printf("%-20s %8.1f %8llu %8llu %8llu %8llu\n", benchmarks[b].name,
+               (double)total / s.count, (unsigned long long)percentile(&s, 0.5),
+               (unsigned long long)percentile(&s, 0.9), (unsigned long long)percentile(&s, 0.99),
+               (unsigned long long)percentile(&s, 0.999));
+    }
+    mem_deinit();
+    free(s.ns);
+    return 0;
+}
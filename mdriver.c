@@ -0,0 +1,708 @@
+/*
+ * mdriver -- replays allocation traces against the allocator.
+ *
+ * Each trace is replayed twice on a fresh heap. The first replay validates
+ * the allocator: every payload is filled with a pattern of its own, which
+ * must be intact when the block is freed or reallocated, so blocks that
+ * overlap or lose data are caught; it also measures utilization, the peak of
+ * the live payload bytes over the peak footprint: mem_heapsize() plus the
+ * pages of the blocks given their own mapping. The second replay only makes
+ * the calls, and is timed. The exit status is non-zero when any trace fails,
+ * so the driver can gate allocator changes. With -c N, the validating replay
+ * also runs mm_check after every N operations; it is a no-op when the
+ * allocator is built with -DNDEBUG.
+ *
+ * Two trace formats are read:
+ *  - the CS:APP text format (.rep): a header of four numbers (suggested heap
+ *    size, number of ids, number of operations, weight), then one operation
+ *    per line: "a id size", "r id size" or "f id";
+ *  - the binary format of mm_trace.h, recorded by mm_trace.c or written by
+ *    mgen. Calls from several threads are replayed in the order of their
+ *    sequence numbers, on one thread. With -t, each recorded thread is
+ *    replayed on a thread of its own instead, so blocks are freed by other
+ *    threads than the ones that allocated them: an operation only waits for
+ *    the earlier operations on its own block. The heap is then checked once,
+ *    at the end of the validating replay, and the driver must be built with
+ *    the allocator's -DMM_THREAD_SAFE. -a sets the number of arenas.
+ *
+ * With -H, the heap is backed by the given pages (see mem_set_hugepages), to
+ * compare page modes on real workloads; tlbbench also counts TLB misses.
+ *
+ * Build:
+ *     cc -O2 mdriver.c mm.c memlib.c -o mdriver
+ *     cc -O2 -DMM_THREAD_SAFE mdriver.c mm.c memlib.c -o mdriver -lpthread
+ * Usage:
+ *     ./mdriver [-n reps] [-p segfit|tlsf] [-c checks] [-t] [-a arenas]
+ *               [-H normal|thp|hugetlb] trace...
+ */
+#include "mm.h"
+#include "memlib.h"
+#include "mm_trace.h"
+
+#include <stdint.h>  // uint64_t, uintptr_t
+#include <stdio.h>   // printf, fprintf, FILE
+#include <stdlib.h>  // malloc, realloc, exit
+#include <string.h>  // memcmp, memset, strcmp
+#include <sched.h>   // sched_yield
+#include <time.h>    // clock_gettime
+#include <unistd.h>  // getopt
+#ifdef MM_THREAD_SAFE
+#include <pthread.h> // pthread_create -- threaded replays
+#endif
+
+#define ALIGNMENT (UINTPTR_MAX > 0xffffffff ? 16 : 8)  // as promised by mm_malloc
+#define MAX_THREADS 256  // threads of a binary trace
+
+/* Operations of a loaded trace */
+enum { OP_ALLOC, OP_CALLOC, OP_REALLOC, OP_FREE };
+
+typedef struct {
+    int type;     // OP_*
+    int index;    // block the operation applies to, from 0
+    int thread;   // recording thread, 0 for text traces
+    size_t size;  // bytes requested
+} Op;
+
+typedef struct {
+    const char *name;
+    int num_ids;      // blocks are numbered 0 to num_ids - 1
+    int num_ops;
+    int num_threads;  // threads are numbered 0 to num_threads - 1
+    Op *ops;
+    int *turns;       // for each operation, the earlier operations on its block
+} Trace;
+
+static int check_interval;  // operations between heap checks, 0 for none
+static int threaded;        // replay each recorded thread on a thread of its own
+
+/**
+ * Reports an error and exits
+ */
+static void die(const char *msg, const char *name) {
+    fprintf(stderr, "mdriver: %s: %s\n", name, msg);
+    exit(1);
+}
+
+/**
+ * Appends an operation to a trace being loaded
+ */
+static void add_op(Trace *trace, int *capacity, int type, int index, int thread, size_t size) {
+    if (trace->num_ops == *capacity) {
+        *capacity = *capacity ? *capacity * 2 : 4096;
+        trace->ops = realloc(trace->ops, *capacity * sizeof(Op));
+        if (trace->ops == NULL)
+            die("out of memory", trace->name);
+    }
+    trace->ops[trace->num_ops++] = (Op) { type, index, thread, size };
+    if (index >= trace->num_ids)
+        trace->num_ids = index + 1;
+    if (thread >= trace->num_threads)
+        trace->num_threads = thread + 1;
+}
+
+/**
+ * Loads a trace in the CS:APP text format
+ */
+static void load_rep(Trace *trace, FILE *f) {
+    int capacity = 0;
+    long header[4];
+    char type;
+    long index;
+    size_t size;
+
+    if (fscanf(f, "%ld %ld %ld %ld", &header[0], &header[1], &header[2], &header[3]) != 4)
+        die("bad header", trace->name);
+    while (fscanf(f, " %c %ld", &type, &index) == 2) {
+        if (index < 0 || index >= INT32_MAX)
+            die("bad block id", trace->name);
+        if (type == 'f') {
+            add_op(trace, &capacity, OP_FREE, (int)index, 0, 0);
+            continue;
+        }
+        if (fscanf(f, "%zu", &size) != 1 || (type != 'a' && type != 'r'))
+            die("bad operation", trace->name);
+        add_op(trace, &capacity, type == 'a' ? OP_ALLOC : OP_REALLOC, (int)index, 0, size);
+    }
+    if (!feof(f))
+        die("bad operation", trace->name);
+}
+
+/*
+ * Ids of binary traces (block addresses) are mapped to dense indices with an
+ * open addressing table; an id is removed when its block is freed, since the
+ * address can come back for another block.
+ */
+typedef struct {
+    uint64_t *keys;   // 0 = empty slot, UINT64_MAX = removed
+    int *values;
+    size_t mask;      // capacity - 1, a power of two
+    size_t used;      // slots that are not empty
+} IdMap;
+
+static size_t id_hash(uint64_t id) {
+    id ^= id >> 33;
+    id *= 0xff51afd7ed558ccdULL;
+    return (size_t)(id ^ id >> 33);
+}
+
+static void id_map_init(IdMap *map, size_t capacity) {
+    map->keys = calloc(capacity, sizeof(uint64_t));
+    map->values = malloc(capacity * sizeof(int));
+    if (map->keys == NULL || map->values == NULL)
+        die("out of memory", "id map");
+    map->mask = capacity - 1;
+    map->used = 0;
+}
+
+/**
+ * @return the slot of an id, or the empty slot where it would go
+ */
+static size_t id_map_slot(IdMap *map, uint64_t id) {
+    size_t i = id_hash(id) & map->mask;
+    while (map->keys[i] != 0 && map->keys[i] != id)
+        i = (i + 1) & map->mask;
+    return i;
+}
+
+static void id_map_put(IdMap *map, uint64_t id, int value);
+
+static void id_map_grow(IdMap *map) {
+    IdMap old = *map;
+    id_map_init(map, (old.mask + 1) * 2);
+    for (size_t i = 0; i <= old.mask; i++)
+        if (old.keys[i] != 0 && old.keys[i] != UINT64_MAX)
+            id_map_put(map, old.keys[i], old.values[i]);
+    free(old.keys);
+    free(old.values);
+}
+
+static void id_map_put(IdMap *map, uint64_t id, int value) {
+    if ((map->used + 1) * 2 > map->mask + 1)
+        id_map_grow(map);  // also sweeps the removed slots
+    size_t i = id_map_slot(map, id);
+    if (map->keys[i] == 0)
+        map->used++;
+    map->keys[i] = id;
+    map->values[i] = value;
+}
+
+/**
+ * @return the index mapped to an id, or -1
+ */
+static int id_map_get(IdMap *map, uint64_t id) {
+    size_t i = id_map_slot(map, id);
+    return map->keys[i] == id ? map->values[i] : -1;
+}
+
+static void id_map_remove(IdMap *map, uint64_t id) {
+    size_t i = id_map_slot(map, id);
+    if (map->keys[i] == id)
+        map->keys[i] = UINT64_MAX;
+}
+
+/*
+ * A record of a binary trace takes effect in two steps: the call at its seq,
+ * and the id of the block it returns at its new_seq.
+ */
+typedef struct {
+    uint64_t seq;
+    int record;    // position in the file
+    int returned;  // whether this is the new_seq step
+} Step;
+
+static int compare_steps(const void *a, const void *b) {
+    const Step *x = a, *y = b;
+    if (x->seq != y->seq)
+        return x->seq < y->seq ? -1 : 1;
+    return x->returned - y->returned;  // a call takes effect before it returns
+}
+
+/**
+ * Loads a trace recorded by mm_trace.c, in the order of its sequence
+ * numbers; calls that failed are left out
+ */
+static void load_binary(Trace *trace, FILE *f) {
+    TraceHeader header;
+    TraceRecord *recs = NULL;
+    size_t num_recs = 0, recs_capacity = 0;
+    IdMap ids;
+    int capacity = 0;
+
+    if (fread(&header, sizeof(header), 1, f) != 1 || header.version != TRACE_VERSION ||
+            header.record_size != sizeof(TraceRecord))
+        die("unsupported trace version", trace->name);
+    for (;;) {
+        if (num_recs == recs_capacity) {
+            recs_capacity = recs_capacity ? recs_capacity * 2 : 4096;
+            recs = realloc(recs, recs_capacity * sizeof(TraceRecord));
+            if (recs == NULL || recs_capacity > INT32_MAX)
+                die("out of memory", trace->name);
+        }
+        if (fread(&recs[num_recs], sizeof(TraceRecord), 1, f) != 1)
+            break;
+        num_recs++;
+    }
+    Step *steps = malloc(2 * num_recs * sizeof(Step));
+    int *indices = malloc(num_recs * sizeof(int));  // block of each record
+    if ((steps == NULL || indices == NULL) && num_recs > 0)
+        die("out of memory", trace->name);
+    for (size_t r = 0; r < num_recs; r++) {
+        steps[2 * r] = (Step) { recs[r].seq, (int)r, 0 };
+        steps[2 * r + 1] = (Step) { recs[r].new_seq, (int)r, 1 };
+    }
+    qsort(steps, 2 * num_recs, sizeof(Step), compare_steps);
+
+    id_map_init(&ids, 1024);
+    for (size_t s = 0; s < 2 * num_recs; s++) {
+        TraceRecord *rec = &recs[steps[s].record];
+        int *index = &indices[steps[s].record];
+        if (steps[s].returned) {
+            // the block keeps its index, under the id it was returned as
+            if (rec->new_id != 0 && *index >= 0)
+                id_map_put(&ids, rec->new_id, *index);
+            continue;
+        }
+        if (rec->thread >= MAX_THREADS)
+            die("too many threads", trace->name);
+        *index = rec->id != 0 ? id_map_get(&ids, rec->id) : -1;
+        if (rec->id != 0 && *index < 0)
+            die("unknown block id", trace->name);
+        switch (rec->op) {
+        case TRACE_MALLOC:
+        case TRACE_CALLOC:
+            if (rec->new_id == 0)
+                break;
+            *index = trace->num_ids;
+            add_op(trace, &capacity, rec->op == TRACE_MALLOC ? OP_ALLOC : OP_CALLOC,
+                   *index, rec->thread, rec->size);
+            break;
+        case TRACE_REALLOC:
+            if (rec->id == 0) {
+                // realloc(NULL, size) allocates
+                if (rec->new_id == 0)
+                    break;
+                *index = trace->num_ids;
+                add_op(trace, &capacity, OP_ALLOC, *index, rec->thread, rec->size);
+            } else if (rec->size == 0) {
+                // realloc(ptr, 0) frees
+                id_map_remove(&ids, rec->id);
+                add_op(trace, &capacity, OP_FREE, *index, rec->thread, 0);
+            } else if (rec->new_id != 0) {
+                id_map_remove(&ids, rec->id);
+                add_op(trace, &capacity, OP_REALLOC, *index, rec->thread, rec->size);
+            }
+            break;
+        case TRACE_FREE:
+            id_map_remove(&ids, rec->id);
+            add_op(trace, &capacity, OP_FREE, *index, rec->thread, 0);
+            break;
+        default:
+            die("bad operation", trace->name);
+        }
+    }
+    free(ids.keys);
+    free(ids.values);
+    free(steps);
+    free(indices);
+    free(recs);
+}
+
+/**
+ * Loads a trace, telling the formats apart by the magic of binary traces
+ */
+static void load_trace(Trace *trace, const char *name) {
+    FILE *f = fopen(name, "rb");
+    char magic[sizeof(TRACE_MAGIC)];
+
+    if (f == NULL)
+        die("cannot open", name);
+    memset(trace, 0, sizeof(*trace));
+    trace->name = name;
+    if (fread(magic, sizeof(magic), 1, f) == 1 && memcmp(magic, TRACE_MAGIC, sizeof(magic)) == 0) {
+        rewind(f);
+        load_binary(trace, f);
+    } else {
+        rewind(f);
+        load_rep(trace, f);
+    }
+    fclose(f);
+
+    // threads of a threaded replay wait for the earlier operations on a block
+    int *counts = calloc(trace->num_ids, sizeof(int));
+    trace->turns = malloc(trace->num_ops * sizeof(int));
+    if ((counts == NULL && trace->num_ids > 0) || (trace->turns == NULL && trace->num_ops > 0))
+        die("out of memory", name);
+    for (int i = 0; i < trace->num_ops; i++)
+        trace->turns[i] = counts[trace->ops[i].index]++;
+    free(counts);
+}
+
+/**
+ * Starts a replay on an empty heap
+ */
+static void reset_heap(const char *name) {
+    mem_reset_brk();
+    if (mm_init() < 0)
+        die("mm_init failed", name);
+}
+
+/**
+ * @return the byte a block is filled with, different for neighbor indices
+ */
+static unsigned char pattern(int index) {
+    return (unsigned char)(index * 37 + 11);
+}
+
+/**
+ * @return whether the first `size` bytes of a payload all hold `byte`
+ */
+static int check_fill(const unsigned char *ptr, size_t size, unsigned char byte) {
+    for (size_t i = 0; i < size; i++)
+        if (ptr[i] != byte)
+            return 0;
+    return 1;
+}
+
+/**
+ * @return the pages a block takes outside the heap, or 0 for heap blocks
+ */
+static size_t mapped_bytes(void *ptr, size_t size) {
+    if (ptr == NULL || (size_t)((char *)ptr - (char *)mem_heap_lo()) < MAX_HEAP)
+        return 0;
+    size_t page = mem_pagesize();
+    return (size + ALIGNMENT + page - 1) / page * page;  // header included
+}
+
+/*
+ * State of a replay, shared by its threads. In a threaded replay, an
+ * operation waits for the earlier operations on its block, so blocks and
+ * sizes are only touched by one thread at a time; the totals are atomic.
+ */
+typedef struct {
+    Trace *trace;
+    unsigned char **blocks;
+    size_t *sizes;
+    int *done;             // operations done on each block, in a threaded replay
+    size_t live, peak_live, mapped, peak_heap;
+    const char *error;     // first failure, which stops all threads
+} Replay;
+
+/* A thread of a replay */
+typedef struct {
+    Replay *replay;
+    int thread;  // recorded thread it replays, -1 for all of them
+} Worker;
+
+/**
+ * Waits for the earlier operations on the block of an operation, in a
+ * threaded replay
+ * @return 0 if another thread failed meanwhile
+ */
+static int wait_turn(Worker *worker, int i) {
+    Replay *replay = worker->replay;
+    if (worker->thread < 0)
+        return 1;
+    int *done = &replay->done[replay->trace->ops[i].index];
+    while (__atomic_load_n(done, __ATOMIC_ACQUIRE) != replay->trace->turns[i]) {
+        if (__atomic_load_n(&replay->error, __ATOMIC_RELAXED) != NULL)
+            return 0;
+        sched_yield();
+    }
+    return 1;
+}
+
+/**
+ * Lets the next operation on the block of an operation go
+ */
+static void end_turn(Worker *worker, int i) {
+    Replay *replay = worker->replay;
+    if (worker->thread >= 0)
+        __atomic_store_n(&replay->done[replay->trace->ops[i].index],
+                         replay->trace->turns[i] + 1, __ATOMIC_RELEASE);
+}
+
+/**
+ * Raises a peak to a new value if it is larger
+ */
+static void raise_peak(size_t *peak, size_t value) {
+    size_t old = __atomic_load_n(peak, __ATOMIC_RELAXED);
+    while (value > old && !__atomic_compare_exchange_n(peak, &old, value, 1, __ATOMIC_RELAXED,
+                                                      __ATOMIC_RELAXED))
+        ;
+}
+
+/**
+ * Replays the operations of a worker, checking the payloads and measuring
+ * the peaks
+ * @return NULL, as a thread entry point
+ */
+static void *validate_ops(void *arg) {
+    Worker *worker = arg;
+    Replay *replay = worker->replay;
+    Trace *trace = replay->trace;
+    const char *error = NULL;
+
+    for (int i = 0; i < trace->num_ops && error == NULL; i++) {
+        Op *op = &trace->ops[i];
+        if (worker->thread >= 0 && op->thread != worker->thread)
+            continue;
+        if (!wait_turn(worker, i))
+            return NULL;
+        unsigned char *ptr = replay->blocks[op->index];
+        size_t old_size = replay->sizes[op->index];
+
+        if (op->type != OP_ALLOC && op->type != OP_CALLOC && ptr != NULL &&
+                !check_fill(ptr, old_size, pattern(op->index))) {
+            error = "payload overwritten";
+            break;
+        }
+        switch (op->type) {
+        case OP_ALLOC:
+        case OP_CALLOC:
+            if (ptr != NULL) {
+                error = "block allocated twice";
+                break;
+            }
+            if (op->type == OP_ALLOC)
+                ptr = mm_malloc(op->size);
+            else if ((ptr = mm_calloc(1, op->size)) != NULL && !check_fill(ptr, op->size, 0))
+                error = "calloc payload not zero";
+            break;
+        case OP_REALLOC:
+            ptr = mm_realloc(ptr, op->size);
+            if (ptr != NULL && !check_fill(ptr, old_size < op->size ? old_size : op->size,
+                                           pattern(op->index)))
+                error = "realloc lost the payload";
+            break;
+        case OP_FREE:
+            mm_free(ptr);
+            ptr = NULL;
+            break;
+        }
+        if (error != NULL)
+            break;
+        if (op->type != OP_FREE && op->size > 0) {
+            if (ptr == NULL) {
+                error = "out of memory";
+                break;
+            }
+            if ((uintptr_t)ptr % ALIGNMENT != 0) {
+                error = "payload misaligned";
+                break;
+            }
+            memset(ptr, pattern(op->index), op->size);
+        }
+        if (op->type == OP_REALLOC && op->size == 0)
+            ptr = NULL;  // realloc(ptr, 0) frees
+        size_t unmapped = mapped_bytes(replay->blocks[op->index], old_size);
+        replay->blocks[op->index] = ptr;
+        replay->sizes[op->index] = ptr != NULL ? op->size : 0;
+        // sizes wrap around when they go down, like the totals
+        size_t mapped = __atomic_add_fetch(&replay->mapped,
+                                           mapped_bytes(ptr, replay->sizes[op->index]) - unmapped,
+                                           __ATOMIC_RELAXED);
+        size_t live = __atomic_add_fetch(&replay->live, replay->sizes[op->index] - old_size,
+                                         __ATOMIC_RELAXED);
+        raise_peak(&replay->peak_live, live);
+        raise_peak(&replay->peak_heap, mem_heapsize() + mapped);
+        // other threads keep changing the heap: threaded replays check it at the end
+        if (worker->thread < 0 && check_interval > 0 && (i + 1) % check_interval == 0 &&
+                mm_check() != 0)
+            error = "heap check failed";  // details on stderr
+        end_turn(worker, i);
+    }
+    if (error != NULL) {
+        const char *none = NULL;
+        __atomic_compare_exchange_n(&replay->error, &none, error, 0, __ATOMIC_RELAXED,
+                                    __ATOMIC_RELAXED);
+    }
+    return NULL;
+}
+
+/**
+ * Replays the operations of a worker with no checks
+ * @return NULL, as a thread entry point
+ */
+static void *time_ops(void *arg) {
+    Worker *worker = arg;
+    Trace *trace = worker->replay->trace;
+    void **blocks = (void **)worker->replay->blocks;
+
+    for (int i = 0; i < trace->num_ops; i++) {
+        Op *op = &trace->ops[i];
+        if (worker->thread >= 0 && op->thread != worker->thread)
+            continue;
+        wait_turn(worker, i);
+        switch (op->type) {
+        case OP_ALLOC:
+            blocks[op->index] = mm_malloc(op->size);
+            break;
+        case OP_CALLOC:
+            blocks[op->index] = mm_calloc(1, op->size);
+            break;
+        case OP_REALLOC:
+            blocks[op->index] = mm_realloc(blocks[op->index], op->size);
+            break;
+        case OP_FREE:
+            mm_free(blocks[op->index]);
+            blocks[op->index] = NULL;
+            break;
+        }
+        end_turn(worker, i);
+    }
+    return NULL;
+}
+
+/**
+ * Replays a trace on an empty heap: on this thread, or with -t on one thread
+ * for each recorded thread; the blocks left are freed afterwards
+ * @param run - validate_ops or time_ops
+ * @param replay - receives the totals and the error of the replay
+ * @return elapsed seconds
+ */
+static double run_replay(Trace *trace, void *(*run)(void *), Replay *replay) {
+    Worker workers[MAX_THREADS];
+    struct timespec start, end;
+
+    memset(replay, 0, sizeof(*replay));
+    replay->trace = trace;
+    replay->blocks = calloc(trace->num_ids, sizeof(unsigned char *));
+    replay->sizes = calloc(trace->num_ids, sizeof(size_t));
+    replay->done = calloc(trace->num_ids, sizeof(int));
+    if ((replay->blocks == NULL || replay->sizes == NULL || replay->done == NULL) &&
+            trace->num_ids > 0)
+        die("out of memory", trace->name);
+    reset_heap(trace->name);
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    if (!threaded) {
+        workers[0] = (Worker) { replay, -1 };
+        run(&workers[0]);
+    } else {
+#ifdef MM_THREAD_SAFE
+        pthread_t tids[MAX_THREADS];
+        for (int t = 0; t < trace->num_threads; t++) {
+            workers[t] = (Worker) { replay, t };
+            if (pthread_create(&tids[t], NULL, run, &workers[t]) != 0)
+                die("cannot create threads", trace->name);
+        }
+        for (int t = 0; t < trace->num_threads; t++)
+            pthread_join(tids[t], NULL);
+#endif
+        if (run == validate_ops && replay->error == NULL && check_interval > 0 && mm_check() != 0)
+            replay->error = "heap check failed";
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+
+    for (int k = 0; k < trace->num_ids; k++)
+        mm_free(replay->blocks[k]);  // mappings outlive the heap reset otherwise
+    free(replay->blocks);
+    free(replay->sizes);
+    free(replay->done);
+    return (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+}
+
+/**
+ * Replays a trace, checking the payloads and measuring utilization
+ * @param util - peak payload over peak heap size, set on success
+ * @return NULL on success, otherwise what went wrong
+ */
+static const char *validate(Trace *trace, double *util) {
+    Replay replay;
+    run_replay(trace, validate_ops, &replay);
+    *util = replay.peak_heap > 0 ? (double)replay.peak_live / replay.peak_heap : 0;
+    return replay.error;
+}
+
+/**
+ * Replays a trace with no checks
+ * @return elapsed seconds
+ */
+static double timed_replay(Trace *trace) {
+    Replay replay;
+    return run_replay(trace, time_ops, &replay);
+}
+
+static void usage(const char *prog) {
+    fprintf(stderr, "usage: %s [-n reps] [-p segfit|tlsf] [-c checks] [-t] [-a arenas]\n"
+                    "       [-H normal|thp|hugetlb] trace...\n", prog);
+    exit(1);
+}
+
+static const char *page_modes[] = { "normal", "thp", "hugetlb" };
+
+int main(int argc, char **argv) {
+    int reps = 3;
+    int pages = MEM_PAGES_NORMAL;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "n:p:c:ta:H:")) != -1) {
+        if (opt == 'n' && atoi(optarg) > 0) {
+            reps = atoi(optarg);
+        } else if (opt == 'c' && atoi(optarg) > 0) {
+            check_interval = atoi(optarg);
+        } else if (opt == 't') {
+#ifndef MM_THREAD_SAFE
+            die("threaded replays need -DMM_THREAD_SAFE", "-t");
+#endif
+            threaded = 1;
+        } else if (opt == 'a' && mm_setopt(MM_OPT_ARENAS, atoi(optarg)) == 0) {
+            // threads are spread over the arenas
+        } else if (opt == 'H') {
+            for (pages = MEM_PAGES_HUGETLB; pages >= 0; pages--)
+                if (strcmp(optarg, page_modes[pages]) == 0)
+                    break;
+            if (pages < 0)
+                usage(argv[0]);
+        } else if (opt == 'p' && strcmp(optarg, "segfit") == 0) {
+            mm_setopt(MM_OPT_POLICY, MM_POLICY_SEGFIT);
+        } else if (opt == 'p' && strcmp(optarg, "tlsf") == 0) {
+            mm_setopt(MM_OPT_POLICY, MM_POLICY_TLSF);
+        } else {
+            usage(argv[0]);
+        }
+    }
+    if (optind == argc)
+        usage(argv[0]);
+
+    mem_set_hugepages(pages);
+    mem_init();
+    if (mem_hugepages() != pages)
+        fprintf(stderr, "mdriver: -H %s: no huge pages reserved, using %s\n", page_modes[pages],
+                page_modes[mem_hugepages()]);
+    printf("%-24s %10s %6s %7s %10s\n", "trace", "ops", "valid", "util", "Kops/s");
+    long total_ops = 0;
+    double total_secs = 0, total_util = 0;
+    int failed = 0;
+    for (int t = optind; t < argc; t++) {
+        Trace trace;
+        double util, secs = 0;
+        load_trace(&trace, argv[t]);
+        const char *error = validate(&trace, &util);
+        if (error != NULL) {
+            printf("%-24s %10d %6s  %s\n", trace.name, trace.num_ops, "no", error);
+            failed++;
+            free(trace.ops);
+            free(trace.turns);
+            continue;
+        }
+        // best of several runs, to filter out noise
+        for (int r = 0; r < reps; r++) {
+            double s = timed_replay(&trace);
+            if (r == 0 || s < secs)
+                secs = s;
+        }
+        printf("%-24s %10d %6s %6.1f%% %10.0f\n", trace.name, trace.num_ops, "yes",
+               util * 100, secs > 0 ? trace.num_ops / secs / 1e3 : 0);
+        total_ops += trace.num_ops;
+        total_secs += secs;
+        total_util += util;
+        free(trace.ops);
+        free(trace.turns);
+    }
+    int passed = argc - optind - failed;
+    if (passed > 0)
+        printf("%-24s %10ld %6d %6.1f%% %10.0f\n", "total", total_ops, passed,
+               total_util / passed * 100, total_secs > 0 ? total_ops / total_secs / 1e3 : 0);
+    mem_deinit();
+    return failed > 0;
+}
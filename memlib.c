@@ -1,58 +1,224 @@
+#define _GNU_SOURCE  // mremap
 #include "memlib.h"
 
 #include <stdio.h>   // fprintf
 #include <stdlib.h>  // malloc, free, exit
 #include <unistd.h>  // _SC_PAGESIZE
 #include <errno.h>   // ENOMEM
+#include <sys/mman.h> // mmap, mprotect, madvise, mremap -- manage pages
 
-#define MAX_HEAP (40*(1<<20))  /* 40 MB */
+#define HUGE_PAGE (2 << 20)    // huge page size on x86-64 and arm64
+#define COMMIT_SIZE HUGE_PAGE  // pages are committed one huge page at a time
 
+static int mem_pages = MEM_PAGES_NORMAL;
+static char *mem_map_start;  // the whole reservation, for munmap
+static size_t mem_map_size;
 static char *mem_start_brk;
 static char *mem_brk;
 static char *mem_max_addr;
+static char *mem_committed;  // end of the readable and writable pages
+
+/**
+ * Choose the pages backing the heap; takes effect at the next mem_init
+ * @param mode - MEM_PAGES_NORMAL, MEM_PAGES_THP or MEM_PAGES_HUGETLB
+ * @return 0 on success, -1 for an unknown mode
+ */
+int mem_set_hugepages(int mode) {
+    if (mode != MEM_PAGES_NORMAL && mode != MEM_PAGES_THP && mode != MEM_PAGES_HUGETLB)
+        return -1;
+    mem_pages = mode;
+    return 0;
+}
+
+/**
+ * @return the pages backing the heap since mem_init, after any fallback
+ */
+int mem_hugepages(void) {
+    return mem_pages;
+}
 
 void mem_init(void) {
-    if ((mem_start_brk = (char *)malloc(MAX_HEAP)) == NULL) {
-        fprintf(stderr, "mem_init_vm: malloc error\n");
+#ifdef MAP_HUGETLB
+    if (mem_pages == MEM_PAGES_HUGETLB) {
+        // explicit huge pages come from the vm.nr_hugepages pool: fall back to
+        // THP when it is empty or hugetlbfs is missing
+        void *probe = mmap(NULL, HUGE_PAGE, PROT_READ | PROT_WRITE,
+                           MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+        if (probe == MAP_FAILED)
+            mem_pages = MEM_PAGES_THP;
+        else
+            munmap(probe, HUGE_PAGE);
+    }
+#else
+    if (mem_pages == MEM_PAGES_HUGETLB)
+        mem_pages = MEM_PAGES_THP;
+#endif
+
+    // reserve address space only: nothing is committed or resident yet. Huge
+    // pages need a 2 MB aligned heap, so over-reserve by one huge page
+    size_t slack = mem_pages == MEM_PAGES_NORMAL ? 0 : HUGE_PAGE;
+    mem_map_size = MAX_HEAP + slack;
+    mem_map_start = mmap(NULL, mem_map_size, PROT_NONE,
+                         MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (mem_map_start == MAP_FAILED) {
+        fprintf(stderr, "mem_init_vm: mmap error\n");
         exit(1);
     }
+    mem_start_brk = mem_map_start;
+    if (slack > 0)
+        mem_start_brk = (char *)(((uintptr_t)mem_map_start + slack - 1) & ~(uintptr_t)(slack - 1));
+#ifdef MADV_HUGEPAGE
+    // advice set on the reservation carries over to the committed pages
+    if (mem_pages == MEM_PAGES_THP)
+        madvise(mem_start_brk, MAX_HEAP, MADV_HUGEPAGE);
+#endif
 
     mem_max_addr = mem_start_brk + MAX_HEAP;
     mem_brk = mem_start_brk;
+    mem_committed = mem_start_brk;
 }
 
 void mem_deinit(void) {
-    free(mem_start_brk);
+    munmap(mem_map_start, mem_map_size);
 }
 
 void mem_reset_brk() {
     mem_brk = mem_start_brk;
 }
 
-void *mem_sbrk(int incr) {
-    char *old_brk = mem_brk;
-    if (incr < 0 || (mem_brk + incr) > mem_max_addr) {
-        errno = ENOMEM;
-        fprintf(stderr, "ERROR: mem_sbrk failed. Ran out of memory...\n");
-        return (void *)-1;
+#ifdef MAP_HUGETLB
+/**
+ * Map hugetlb pages over the reservation up to `end`. Mapping over committed
+ * pages would replace them, so callers are serialized; the pages are taken
+ * from the pool here, and an empty pool fails instead of faulting later.
+ */
+static int mem_commit_hugetlb(char *end) {
+    static char committing;
+    while (__atomic_test_and_set(&committing, __ATOMIC_ACQUIRE))
+        ;
+    int result = 0;
+    char *committed = __atomic_load_n(&mem_committed, __ATOMIC_ACQUIRE);
+    if (end > committed) {
+        size_t size = (end - committed + COMMIT_SIZE - 1) / COMMIT_SIZE * COMMIT_SIZE;
+        if (size > (size_t)(mem_max_addr - committed))
+            size = mem_max_addr - committed;
+        if (mmap(committed, size, PROT_READ | PROT_WRITE,
+                 MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED | MAP_HUGETLB, -1, 0) == MAP_FAILED)
+            result = -1;
+        else
+            __atomic_store_n(&mem_committed, committed + size, __ATOMIC_RELEASE);
     }
+    __atomic_clear(&committing, __ATOMIC_RELEASE);
+    return result;
+}
+#endif
+
+/**
+ * Make the reserved pages up to `end` readable and writable.
+ * Concurrent callers may commit the same pages twice, which is harmless.
+ */
+static int mem_commit(char *end) {
+    char *committed = __atomic_load_n(&mem_committed, __ATOMIC_ACQUIRE);
+    if (end <= committed)
+        return 0;
+#ifdef MAP_HUGETLB
+    if (mem_pages == MEM_PAGES_HUGETLB)
+        return mem_commit_hugetlb(end);
+#endif
+    size_t size = (end - committed + COMMIT_SIZE - 1) / COMMIT_SIZE * COMMIT_SIZE;
+    if (size > (size_t)(mem_max_addr - committed))
+        size = mem_max_addr - committed;
+    if (mprotect(committed, size, PROT_READ | PROT_WRITE) != 0)
+        return -1;
+    // publish the new end, unless another caller committed further
+    char *new_committed = committed + size;
+    while (!__atomic_compare_exchange_n(&mem_committed, &committed, new_committed, 1,
+                                        __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE))
+        if (committed >= new_committed)
+            break;
+    return 0;
+}
 
-    mem_brk += incr;
+/**
+ * Move the break by `incr` bytes. A negative increment gives the top of the
+ * heap back: its pages stay committed but are no longer resident. Shrinking
+ * must not race with another caller growing the heap.
+ */
+void *mem_sbrk(intptr_t incr) {
+    // move the break with a compare-and-swap, so that concurrent callers each
+    // get their own range; pages are committed before the range is handed out
+    char *old_brk = __atomic_load_n(&mem_brk, __ATOMIC_RELAXED);
+    do {
+        if (incr < -(old_brk - mem_start_brk) || incr > mem_max_addr - old_brk ||
+                mem_commit(old_brk + incr) != 0) {
+            errno = ENOMEM;
+            fprintf(stderr, "ERROR: mem_sbrk failed. Ran out of memory...\n");
+            return (void *)-1;
+        }
+    } while (!__atomic_compare_exchange_n(&mem_brk, &old_brk, old_brk + incr, 1,
+                                          __ATOMIC_ACQ_REL, __ATOMIC_RELAXED));
+
+    if (incr < 0) {
+        // drop the whole pages above the new break
+        size_t page = mem_heap_pagesize();
+        char *first = mem_start_brk +
+                ((old_brk + incr - mem_start_brk) + page - 1) / page * page;
+        if (first < old_brk)
+            madvise(first, old_brk - first, MADV_DONTNEED);
+    }
     return (void *)old_brk;
 }
 
+void mem_purge(void *addr, size_t len) {
+    // release whole heap pages only: hugetlb pages cannot be split, and
+    // dropping part of a transparent huge page splits it into base pages
+    size_t page = mem_heap_pagesize();
+    char *first = (char *)(((uintptr_t)addr + page - 1) & ~(uintptr_t)(page - 1));
+    char *last = (char *)(((uintptr_t)addr + len) & ~(uintptr_t)(page - 1));
+    if (first >= last)
+        return;
+    addr = first;
+    len = last - first;
+    // MADV_DONTNEED, not MADV_FREE: the pages must read as zero afterwards
+    madvise(addr, len, MADV_DONTNEED);
+}
+
+void *mem_map(size_t size) {
+    void *addr = mmap(NULL, size, PROT_READ | PROT_WRITE,
+                      MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    return addr == MAP_FAILED ? NULL : addr;
+}
+
+void mem_unmap(void *addr, size_t size) {
+    munmap(addr, size);
+}
+
+void *mem_remap(void *addr, size_t old_size, size_t new_size) {
+    // the kernel moves the pages if they cannot grow in place: no copy
+    void *new_addr = mremap(addr, old_size, new_size, MREMAP_MAYMOVE);
+    return new_addr == MAP_FAILED ? NULL : new_addr;
+}
+
 void *mem_heap_lo() {
     return (void *)mem_start_brk;  // first heap byte
 }
 
 void *mem_heap_hi() {
-    return (void *)(mem_brk - 1);  // last heap byte
+    return (void *)(__atomic_load_n(&mem_brk, __ATOMIC_ACQUIRE) - 1);  // last heap byte
 }
 
 size_t mem_heapsize() {
-    return (size_t)(mem_brk - mem_start_brk);
+    return (size_t)(__atomic_load_n(&mem_brk, __ATOMIC_ACQUIRE) - mem_start_brk);
 }
 
 size_t mem_pagesize() {
     return (size_t)sysconf(_SC_PAGESIZE);
 }
+
+/**
+ * Size of the pages backing the heap: a shrinking break and mem_purge
+ * release whole pages of this size only
+ */
+size_t mem_heap_pagesize() {
+    return mem_pages == MEM_PAGES_NORMAL ? mem_pagesize() : HUGE_PAGE;
+}
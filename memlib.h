@@ -2,14 +2,36 @@
 #define __MEMLIB_H__
 
 #include <stddef.h>  // size_t
+#include <stdint.h>  // intptr_t, UINTPTR_MAX
 
+/* Address space reserved for the heap; pages are committed as it grows */
+#if UINTPTR_MAX > 0xffffffff
+#define MAX_HEAP ((size_t)64 << 30)  /* 64 GB */
+#else
+#define MAX_HEAP ((size_t)1 << 30)   /* 1 GB */
+#endif
+
+/* Pages backing the heap, see mem_set_hugepages */
+enum {
+    MEM_PAGES_NORMAL,   /* base pages */
+    MEM_PAGES_THP,      /* 2 MB aligned, with transparent huge pages advised */
+    MEM_PAGES_HUGETLB,  /* hugetlbfs pages, falling back to MEM_PAGES_THP */
+};
+
+int mem_set_hugepages(int mode);
+int mem_hugepages(void);
 void mem_init(void);
 void mem_deinit(void);
-void *mem_sbrk(int incr);
+void *mem_sbrk(intptr_t incr);
 void mem_reset_brk(void);
+void mem_purge(void *addr, size_t len);
+void *mem_map(size_t size);
+void mem_unmap(void *addr, size_t size);
+void *mem_remap(void *addr, size_t old_size, size_t new_size);
 void *mem_heap_lo(void);
 void *mem_heap_hi(void);
 size_t mem_heapsize(void);
 size_t mem_pagesize(void);
+size_t mem_heap_pagesize(void);
 
 #endif /* __MEMLIB_H__ */
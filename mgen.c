@@ -0,0 +1,378 @@
+/*
+ * mgen -- generates synthetic allocation traces for mdriver.
+ *
+ * Blocks are allocated one after the other, each with a size and a lifetime
+ * drawn from the chosen distributions; a block is freed once its lifetime,
+ * counted in allocations, has passed. The shape of the live heap over time
+ * decides when blocks die:
+ *  - plateau: by their lifetime, so the heap grows to a steady state;
+ *  - ramp: at the end of the trace, so the heap only grows;
+ *  - peak:N: at the end of each period of N allocations, so the heap rises
+ *    and falls back N by N.
+ * Some allocations can be calloc, and live blocks can be reallocated
+ * following a growth pattern. With several threads, producers allocate and
+ * reallocate the blocks and consumers free them; mdriver -t replays each of
+ * them on a thread of its own. The same seed always gives the same trace.
+ *
+ * Distributions:
+ *     sizes:     fixed:S  uniform:LO:HI  exp:MEAN  pareto:MIN:ALPHA
+ *     lifetimes: fixed:N  uniform:LO:HI  exp:MEAN  bimodal:SHORT:LONG:P_LONG
+ *     growth:    linear:STEP  double  random
+ * Traces ending in .rep are written in the CS:APP text format, which has no
+ * calloc or threads; other files in the binary format of mm_trace.h.
+ *
+ * Build:
+ *     cc -O2 mgen.c -o mgen -lm
+ * Usage:
+ *     ./mgen [-s seed] [-n blocks] [-S sizes] [-L lifetimes] [-p shape]
+ *            [-r realloc_pct] [-g growth] [-c calloc_pct] [-t threads]
+ *            [-M max_size] file
+ * For example, a web-server-like mix of short requests and long caches:
+ *     ./mgen -S pareto:16:1.2 -L bimodal:50:100000:0.05 -r 5 server.trace
+ */
+#include "mm_trace.h"
+
+#include <math.h>    // log, pow
+#include <stdint.h>  // uint64_t
+#include <stdio.h>   // FILE, fprintf
+#include <stdlib.h>  // strtod, malloc, exit
+#include <string.h>  // strcmp, strncmp, strlen
+#include <unistd.h>  // getopt
+
+/* Distributions */
+enum { DIST_FIXED, DIST_UNIFORM, DIST_EXP, DIST_PARETO, DIST_BIMODAL };
+
+typedef struct {
+    int type;          // DIST_*
+    double a, b, c;    // parameters, in the order they are written
+} Dist;
+
+/* Shapes of the live heap over time */
+enum { SHAPE_PLATEAU, SHAPE_RAMP, SHAPE_PEAK };
+
+/* Realloc growth patterns */
+enum { GROW_LINEAR, GROW_DOUBLE, GROW_RANDOM };
+
+typedef struct {
+    uint64_t death;  // allocation count at which the block is freed
+    int index;
+} Death;
+
+static uint64_t rng_state;
+static size_t max_size = 1 << 20;
+
+static TraceRecord *records;
+static size_t num_records, records_capacity;
+
+/**
+ * Reports an error and exits
+ */
+static void die(const char *msg, const char *arg) {
+    fprintf(stderr, "mgen: %s: %s\n", msg, arg);
+    exit(1);
+}
+
+/**
+ * xorshift64*, as the trace must not depend on the C library
+ * @return a uniform double in [0, 1)
+ */
+static double next_random(void) {
+    rng_state ^= rng_state >> 12;
+    rng_state ^= rng_state << 25;
+    rng_state ^= rng_state >> 27;
+    return (rng_state * 0x2545f4914f6cdd1dULL >> 11) * (1.0 / 9007199254740992.0);
+}
+
+/**
+ * Parses a distribution written as NAME:A:B:C
+ * @param allowed - bit mask of the DIST_* types accepted
+ */
+static Dist parse_dist(const char *spec, int allowed) {
+    static const char *names[] = { "fixed", "uniform", "exp", "pareto", "bimodal" };
+    static const int params[] = { 1, 2, 1, 2, 3 };
+    Dist dist = { -1, 0, 0, 0 };
+    double *values[] = { &dist.a, &dist.b, &dist.c };
+
+    for (int t = 0; t < 5; t++) {
+        size_t len = strlen(names[t]);
+        if (strncmp(spec, names[t], len) == 0 && spec[len] == ':' && (allowed >> t & 1))
+            dist.type = t;
+    }
+    if (dist.type < 0)
+        die("unknown distribution", spec);
+    const char *p = strchr(spec, ':');
+    for (int i = 0; i < params[dist.type]; i++) {
+        char *end;
+        if (p == NULL || *p != ':')
+            die("missing parameter", spec);
+        *values[i] = strtod(p + 1, &end);
+        if (end == p + 1 || *values[i] < 0)
+            die("bad parameter", spec);
+        p = end;
+    }
+    if (p == NULL || *p != '\0')
+        die("too many parameters", spec);
+    if ((dist.type == DIST_PARETO && dist.b == 0) || (dist.type == DIST_BIMODAL && dist.c > 1))
+        die("bad parameter", spec);
+    return dist;
+}
+
+/**
+ * Draws a value from a distribution
+ */
+static double draw(Dist *dist) {
+    double u = next_random();
+    switch (dist->type) {
+    case DIST_FIXED:
+        return dist->a;
+    case DIST_UNIFORM:
+        return dist->a + u * (dist->b - dist->a + 1);
+    case DIST_EXP:
+        return -dist->a * log(1 - u);
+    case DIST_PARETO:
+        return dist->a / pow(1 - u, 1 / dist->b);
+    case DIST_BIMODAL:
+        // short lifetimes, with a fraction c of long ones; both exponential
+        return -(u < dist->c ? dist->b : dist->a) * log(1 - next_random());
+    }
+    return 0;
+}
+
+/**
+ * @return a block size drawn from the size distribution, in [1, max_size]
+ */
+static size_t draw_size(Dist *sizes) {
+    double size = draw(sizes);
+    if (size < 1)
+        return 1;
+    return size >= max_size ? max_size : (size_t)size;
+}
+
+/**
+ * Appends a record to the trace; ids are block indices plus one, as 0 is NULL
+ */
+static void emit(int op, int index, size_t size, uint32_t thread) {
+    if (num_records == records_capacity) {
+        records_capacity = records_capacity ? records_capacity * 2 : 4096;
+        records = realloc(records, records_capacity * sizeof(TraceRecord));
+        if (records == NULL)
+            die("out of memory", "trace");
+    }
+    TraceRecord *rec = &records[num_records];
+    rec->seq = rec->new_seq = num_records;  // calls take effect at once
+    rec->time = num_records++;  // one tick per call
+    rec->size = size;
+    rec->id = op == TRACE_FREE || op == TRACE_REALLOC ? (uint64_t)index + 1 : 0;
+    rec->new_id = op == TRACE_FREE ? 0 : (uint64_t)index + 1;
+    rec->thread = thread;
+    rec->op = op;
+}
+
+/* Min-heap of the live blocks by time of death */
+static Death *heap;
+static size_t heap_len;
+
+static void heap_push(uint64_t death, int index) {
+    size_t i = heap_len++;
+    while (i > 0 && heap[(i - 1) / 2].death > death) {
+        heap[i] = heap[(i - 1) / 2];
+        i = (i - 1) / 2;
+    }
+    heap[i] = (Death) { death, index };
+}
+
+static Death heap_pop(void) {
+    Death top = heap[0], last = heap[--heap_len];
+    size_t i = 0;
+    while (2 * i + 1 < heap_len) {
+        size_t child = 2 * i + 1;
+        if (child + 1 < heap_len && heap[child + 1].death < heap[child].death)
+            child++;
+        if (last.death <= heap[child].death)
+            break;
+        heap[i] = heap[child];
+        i = child;
+    }
+    heap[i] = last;
+    return top;
+}
+
+/**
+ * Writes the trace in the CS:APP text format
+ */
+static void write_rep(FILE *f, int num_ids, size_t peak_bytes) {
+    fprintf(f, "%zu\n%d\n%zu\n1\n", peak_bytes, num_ids, num_records);
+    for (size_t i = 0; i < num_records; i++) {
+        TraceRecord *rec = &records[i];
+        if (rec->op == TRACE_FREE)
+            fprintf(f, "f %llu\n", (unsigned long long)rec->id - 1);
+        else
+            fprintf(f, "%c %llu %llu\n", rec->op == TRACE_REALLOC ? 'r' : 'a',
+                    (unsigned long long)rec->new_id - 1, (unsigned long long)rec->size);
+    }
+}
+
+/**
+ * Writes the trace in the binary format
+ */
+static void write_binary(FILE *f) {
+    TraceHeader header;
+    memset(&header, 0, sizeof(header));
+    strcpy(header.magic, TRACE_MAGIC);
+    header.version = TRACE_VERSION;
+    header.record_size = sizeof(TraceRecord);
+    fwrite(&header, sizeof(header), 1, f);
+    fwrite(records, sizeof(TraceRecord), num_records, f);
+}
+
+static void usage(const char *prog) {
+    fprintf(stderr, "usage: %s [-s seed] [-n blocks] [-S sizes] [-L lifetimes] [-p shape]\n"
+                    "       [-r realloc_pct] [-g growth] [-c calloc_pct] [-t threads]\n"
+                    "       [-M max_size] file\n", prog);
+    exit(1);
+}
+
+int main(int argc, char **argv) {
+    Dist sizes = parse_dist("exp:256", 1 << DIST_FIXED | 1 << DIST_UNIFORM | 1 << DIST_EXP | 1 << DIST_PARETO);
+    Dist lifetimes = parse_dist("exp:1000", 1 << DIST_FIXED | 1 << DIST_UNIFORM | 1 << DIST_EXP | 1 << DIST_BIMODAL);
+    int shape = SHAPE_PLATEAU, growth = GROW_DOUBLE;
+    long blocks = 100000, period = 0;
+    double realloc_pct = 0, calloc_pct = 0, growth_step = 0;
+    int threads = 1;
+    int opt;
+
+    rng_state = 88172645463325252ULL;
+    while ((opt = getopt(argc, argv, "s:n:S:L:p:r:g:c:t:M:")) != -1) {
+        switch (opt) {
+        case 's':
+            rng_state ^= strtoull(optarg, NULL, 0) * 0x9e3779b97f4a7c15ULL;
+            if (rng_state == 0)
+                rng_state = 1;
+            break;
+        case 'n':
+            blocks = atol(optarg);
+            break;
+        case 'S':
+            sizes = parse_dist(optarg, 1 << DIST_FIXED | 1 << DIST_UNIFORM | 1 << DIST_EXP | 1 << DIST_PARETO);
+            break;
+        case 'L':
+            lifetimes = parse_dist(optarg, 1 << DIST_FIXED | 1 << DIST_UNIFORM | 1 << DIST_EXP | 1 << DIST_BIMODAL);
+            break;
+        case 'p':
+            if (strcmp(optarg, "plateau") == 0)
+                shape = SHAPE_PLATEAU;
+            else if (strcmp(optarg, "ramp") == 0)
+                shape = SHAPE_RAMP;
+            else if (strncmp(optarg, "peak:", 5) == 0 && (period = atol(optarg + 5)) > 0)
+                shape = SHAPE_PEAK;
+            else
+                die("unknown shape", optarg);
+            break;
+        case 'r':
+            realloc_pct = atof(optarg);
+            break;
+        case 'g':
+            if (strncmp(optarg, "linear:", 7) == 0 && (growth_step = atof(optarg + 7)) >= 1)
+                growth = GROW_LINEAR;
+            else if (strcmp(optarg, "double") == 0)
+                growth = GROW_DOUBLE;
+            else if (strcmp(optarg, "random") == 0)
+                growth = GROW_RANDOM;
+            else
+                die("unknown growth pattern", optarg);
+            break;
+        case 'c':
+            calloc_pct = atof(optarg);
+            break;
+        case 't':
+            threads = atoi(optarg);
+            break;
+        case 'M':
+            max_size = strtoull(optarg, NULL, 0);
+            break;
+        default:
+            usage(argv[0]);
+        }
+    }
+    if (optind != argc - 1 || blocks < 1 || blocks > INT32_MAX - 1 || threads < 1 ||
+            max_size < 1 || realloc_pct < 0 || realloc_pct >= 100 || calloc_pct < 0 || calloc_pct > 100)
+        usage(argv[0]);
+    const char *path = argv[optind];
+    size_t len = strlen(path);
+    int rep = len >= 4 && strcmp(path + len - 4, ".rep") == 0;
+
+    // with several threads, the first half produce and the second half consume
+    uint32_t producers = threads > 1 ? threads / 2 : 1;
+    uint32_t consumers = threads > 1 ? threads - producers : 0;
+    size_t *block_sizes = malloc(blocks * sizeof(size_t));
+    uint32_t *owners = malloc(blocks * sizeof(uint32_t));
+    heap = malloc(blocks * sizeof(Death));
+    if (block_sizes == NULL || owners == NULL || heap == NULL)
+        die("out of memory", path);
+
+    size_t live_bytes = 0, peak_bytes = 0;
+    int allocated = 0;
+    while (allocated < blocks) {
+        // free the blocks whose time has come
+        while (heap_len > 0 && heap[0].death <= (uint64_t)allocated) {
+            Death d = heap_pop();
+            uint32_t thread = consumers ? producers + (uint32_t)(next_random() * consumers) : 0;
+            emit(TRACE_FREE, d.index, 0, thread);
+            live_bytes -= block_sizes[d.index];
+        }
+
+        if (heap_len > 0 && next_random() * 100 < realloc_pct) {
+            // grow a live block; the heap keeps its death
+            int index = heap[(size_t)(next_random() * heap_len)].index;
+            size_t old_size = block_sizes[index], size = old_size;
+            if (growth == GROW_LINEAR)
+                size = old_size + (size_t)growth_step;
+            else if (growth == GROW_DOUBLE)
+                size = old_size * 2;
+            else
+                size = draw_size(&sizes);
+            size = size > max_size ? max_size : size;
+            emit(TRACE_REALLOC, index, size, owners[index]);
+            block_sizes[index] = size;
+            live_bytes += size - old_size;
+        } else {
+            int index = allocated++;
+            uint64_t death;
+            if (shape == SHAPE_RAMP)
+                death = UINT64_MAX;
+            else if (shape == SHAPE_PEAK)
+                death = ((uint64_t)index / period + 1) * period;
+            else
+                death = index + 1 + (uint64_t)draw(&lifetimes);
+            block_sizes[index] = draw_size(&sizes);
+            owners[index] = (uint32_t)(next_random() * producers);
+            emit(!rep && next_random() * 100 < calloc_pct ? TRACE_CALLOC : TRACE_MALLOC,
+                 index, block_sizes[index], owners[index]);
+            heap_push(death, index);
+            live_bytes += block_sizes[index];
+        }
+        if (live_bytes > peak_bytes)
+            peak_bytes = live_bytes;
+    }
+    while (heap_len > 0) {
+        Death d = heap_pop();
+        emit(TRACE_FREE, d.index, 0, consumers ? producers + (uint32_t)(next_random() * consumers) : 0);
+    }
+
+    FILE *f = fopen(path, rep ? "w" : "wb");
+    if (f == NULL)
+        die("cannot create", path);
+    if (rep)
+        write_rep(f, allocated, peak_bytes);
+    else
+        write_binary(f);
+    if (fclose(f) != 0)
+        die("write failed", path);
+    fprintf(stderr, "%s: %zu operations, %d blocks, peak %zu bytes live\n",
+            path, num_records, allocated, peak_bytes);
+    free(block_sizes);
+    free(owners);
+    free(heap);
+    free(records);
+    return 0;
+}
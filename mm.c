@@ -1,20 +1,117 @@
 #include "mm.h"      // prototypes of functions implemented in this file
 
 #include "memlib.h"  // mem_sbrk -- to extend the heap
+#include <limits.h>  // INT_MAX -- largest option value
+#include <stdint.h>  // uint32_t, uint64_t -- block headers, bitmaps of free lists
 #include <string.h>  // memcpy -- to copy regions of memory
+#include <time.h>    // clock_gettime -- age of dirty free blocks
+#ifdef MM_THREAD_SAFE
+#include <pthread.h> // pthread_mutex_t -- locks for thread-safe builds
+#endif
+#if defined(MM_LATENCY) || !defined(NDEBUG)
+#include <stdio.h>   // snprintf, fprintf -- latency dump, heap checker
+#endif
+#ifdef MM_LATENCY
+#include <stdlib.h>  // atexit -- latency dump at exit
+#include <unistd.h>  // write -- latency dump
+#endif
+#ifdef MM_TRACE
+#include "mm_trace.h" // mm_untraced_* -- names of the recorded functions
+#endif
 
 #define MAX(x, y) ((x) > (y) ? (x) : (y))
 #define MIN(x, y) ((x) > (y) ? (y) : (x))
 
+/**
+ * Compiled with -DMM_TRACE, the public allocation functions are defined under
+ * other names, and mm_trace.c records each call before passing it on.
+ * Compiled with -DMM_LATENCY, their bodies get other names again, and timing
+ * wrappers at the end of this file take the exported names. Calls made from
+ * inside the allocator are neither recorded nor timed.
+ */
+#ifdef MM_TRACE
+#define EXPORT_NAME(name) mm_untraced_##name
+#else
+#define EXPORT_NAME(name) mm_##name
+#endif
+#ifdef MM_LATENCY
+#define BODY_NAME(name) untimed_##name
+#else
+#define BODY_NAME(name) EXPORT_NAME(name)
+#endif
+#define mm_malloc  BODY_NAME(malloc)
+#define mm_calloc  BODY_NAME(calloc)
+#define mm_realloc BODY_NAME(realloc)
+#define mm_free    BODY_NAME(free)
+#ifdef MM_LATENCY
+static void *mm_malloc(size_t size);
+static void *mm_calloc(size_t count, size_t size);
+static void *mm_realloc(void *ptr, size_t size);
+static void  mm_free(void *ptr);
+#endif
+
+/**
+ * Compiled with -DMM_THREAD_SAFE, the allocator can be called from several
+ * threads. The lock of an arena protects its boundary tags, free lists and
+ * tree (coalescing touches neighbors of any size, so they cannot be split by
+ * size class); each slab class of an arena has its own lock, taken before the
+ * arena lock when a run is created or released; chunk_lock, taken last,
+ * serializes the growth of the heap. stats_lock only guards the list of
+ * allocation counts, and no other lock is taken under it. Otherwise locks
+ * compile to nothing.
+ */
+#ifdef MM_THREAD_SAFE
+typedef pthread_mutex_t Lock;
+#define LOCK_INITIALIZER PTHREAD_MUTEX_INITIALIZER
+
+static void lock(Lock *l) {
+    pthread_mutex_lock(l);
+}
+
+static void unlock(Lock *l) {
+    pthread_mutex_unlock(l);
+}
+#else
+typedef int Lock;
+#define LOCK_INITIALIZER 0
+
+static void lock(Lock *l) {
+    (void)l;
+}
+
+static void unlock(Lock *l) {
+    (void)l;
+}
+#endif
+
+/**
+ * Blocks and payloads are aligned to 8 bytes with 4-byte pointers (-m32), and
+ * to 16 bytes in 64-bit builds as the x86-64 ABI requires for malloc.
+ */
+#if UINTPTR_MAX > 0xffffffff
+#define ALIGNMENT 16
+#else
+#define ALIGNMENT 8
+#endif
+
 /**
  * A block header uses 4 bytes for:
- * - a block size, multiple of 8 (so, the last 3 bits are always 0's)
+ * - a block size, multiple of ALIGNMENT (so, the last 3 bits are always 0's)
  * - an allocated bit (stored as LSB, since the last 3 bits are needed)
+ * - a previous-allocated bit (bit 1), set when the previous block on the heap
+ *   is allocated
+ * - a purged bit (bit 2), set when the pages inside a free block were given
+ *   back to the OS and read as zero; rewriting the header clears it
  *
- * A block footer has the same format.
+ * Only free blocks have a footer, with the same format; allocated blocks use
+ * the whole block after the header as payload, and the previous-allocated bit
+ * of the next block tells whether a footer is there.
  * Check Figure 9.48(a) in the textbook.
  */
-typedef int BlockHeader;
+typedef uint32_t BlockHeader;
+
+/* Largest block size that fits in a header */
+#define MAX_BLOCK_SIZE ((size_t)UINT32_MAX & ~(size_t)(ALIGNMENT - 1))
 
 /**
  * Read the size field from a block header (or footer).
@@ -22,7 +119,7 @@ typedef int BlockHeader;
  * @param bp address of the block header (or footer)
  * @return size in bytes
  */
-static int get_size(BlockHeader *bp) {
+static size_t get_size(BlockHeader *bp) {
     return (*bp) & ~7;  // discard last 3 bits
 }
 
@@ -37,27 +134,69 @@ static int get_allocated(BlockHeader *bp) {
 }
 
 /**
- * Write the size and allocated bit of a given block inside its header.
+ * Read the previous-allocated bit from a block header.
+ *
+ * @param bp address of the block header
+ * @return 1 if the previous block on the heap is allocated, 0 if it is free
+ */
+static int get_prev_allocated(BlockHeader *bp) {
+    return ((*bp) >> 1) & 1;
+}
+
+/**
+ * Write the size and allocated bit of a given block inside its header,
+ * keeping its previous-allocated bit.
  *
  * @param bp address of the block header
- * @param size size in bytes (must be a multiple of 8)
+ * @param size size in bytes (must be a multiple of ALIGNMENT)
  * @param allocated either 0 or 1
  */
-static void set_header(BlockHeader *bp, int size, int allocated) {
-    *bp = size | allocated;
+static void set_header(BlockHeader *bp, size_t size, int allocated) {
+    *bp = size | ((*bp) & 2) | allocated;
+}
+
+/**
+ * Write the previous-allocated bit of a given block inside its header.
+ *
+ * @param bp address of the block header
+ * @param prev_allocated either 0 or 1
+ */
+static void set_prev_allocated(BlockHeader *bp, int prev_allocated) {
+    // atomic store: the header may belong to an allocated block whose size
+    // another thread reads without the heap lock (see tcache_put)
+    __atomic_store_n(bp, ((*bp) & ~2) | (prev_allocated << 1), __ATOMIC_RELAXED);
+}
+
+/**
+ * Read the purged bit from a block header.
+ *
+ * @param bp address of the block header
+ * @return 1 if the whole pages inside the free block are zero, 0 otherwise
+ */
+static int get_purged(BlockHeader *bp) {
+    return ((*bp) >> 2) & 1;
+}
+
+/**
+ * Set the purged bit of a free block.
+ *
+ * @param bp address of the block header
+ */
+static void set_purged(BlockHeader *bp) {
+    *bp |= 4;
 }
 
 /**
  * Write the size and allocated bit of a given block inside its footer.
+ * Only free blocks have a footer.
  *
  * @param bp address of the block header
- * @param size size in bytes (must be a multiple of 8)
+ * @param size size in bytes (must be a multiple of ALIGNMENT)
  * @param allocated either 0 or 1
  */
-static void set_footer(BlockHeader *bp, int size, int allocated) {
-    char *footer_addr = (char *)bp + get_size(bp) - 4;
-    // the footer has the same format as the header
-    set_header((BlockHeader *)footer_addr, size, allocated);
+static void set_footer(BlockHeader *bp, size_t size, int allocated) {
+    BlockHeader *footer = (BlockHeader *)((char *)bp + get_size(bp) - 4);
+    *footer = size | allocated;
 }
 
 /**
@@ -75,13 +214,14 @@ static char *get_payload_addr(BlockHeader *bp) {
 /**
  * Find the header address of the previous block on the heap.
  *
- * @param bp address of a block header
+ * @param bp address of a block header (the previous block must be free,
+ *        allocated blocks have no footer)
  * @return address of the header of the previous block
  */
 static BlockHeader *get_prev(BlockHeader *bp) {
     // move back by 4 bytes to find the footer of the previous block
     BlockHeader *previous_footer = bp - 1; //move back 4 bytes
-    int previous_size = get_size(previous_footer); //get prev size
+    size_t previous_size = get_size(previous_footer); //get prev size
     char *previous_addr = (char *)bp - previous_size;
     return (BlockHeader *)previous_addr;
 }
@@ -93,25 +233,60 @@ static BlockHeader *get_prev(BlockHeader *bp) {
  * @return address of the header of the next block
  */
 static BlockHeader *get_next(BlockHeader *bp) {
-    int this_size = get_size(bp);
-     // TODO: to implement, look at get_prev
+    size_t this_size = get_size(bp);
     char *next_addr = (char *)bp+this_size; //set next address
     return (BlockHeader *)next_addr;
 }
 
 /**
  * In addition to the block header with size/allocated bit, a free block has
- * pointers to the headers of the previous and next blocks on the free list.
+ * links to the headers of the previous and next blocks on the free list.
  *
- * Pointers use 4 bytes because this project is compiled with -m32.
+ * Links are 32-bit offsets from the start of the heap (in ALIGNMENT units, so
+ * they reach 2^32 * ALIGNMENT bytes) rather than pointers, so that a free block
+ * fits in 16 bytes in 64-bit builds too. Offset 0 is the null link: no block
+ * header is at the very start of the heap.
  * Check Figure 9.48(b) in the textbook.
  */
+typedef uint32_t BlockOffset;
+
 typedef struct {
     BlockHeader header;
-    BlockHeader *prev_free;
-    BlockHeader *next_free;
+    BlockOffset prev_free;
+    BlockOffset next_free;
 } FreeBlockHeader;
 
+/* Start of the heap, the base of all block offsets */
+static char *heap_base;
+
+/**
+ * Convert a block header address to a link.
+ *
+ * @param bp address of a block header, or `NULL`
+ * @return offset of the payload from heap_base in ALIGNMENT units, 0 for `NULL`
+ */
+static BlockOffset to_offset(BlockHeader *bp) {
+    if (bp == NULL)
+        return 0;
+    return (get_payload_addr(bp) - heap_base) / ALIGNMENT;
+}
+
+/**
+ * Convert a link back to a block header address.
+ *
+ * @param offset link written by to_offset
+ * @return address of the block header, or `NULL` for offset 0
+ */
+static BlockHeader *from_offset(BlockOffset offset) {
+    if (offset == 0)
+        return NULL;
+    return (BlockHeader *)(heap_base + (size_t)offset * ALIGNMENT) - 1;
+}
+
+/* Smallest block: header, the two free list links and footer */
+#define MIN_BLOCK_SIZE \
+    ((int)((sizeof(FreeBlockHeader) + 4 + ALIGNMENT - 1) / ALIGNMENT * ALIGNMENT))
+
 /**
  * Find the header address of the previous **free** block on the **free list**.
  *
@@ -120,7 +295,7 @@ typedef struct {
  */
 static BlockHeader *get_prev_free(BlockHeader *bp) {
     FreeBlockHeader *fp = (FreeBlockHeader *)bp;
-    return fp->prev_free;
+    return from_offset(fp->prev_free);
 }
 
 /**
@@ -131,7 +306,7 @@ static BlockHeader *get_prev_free(BlockHeader *bp) {
  */
 static BlockHeader *get_next_free(BlockHeader *bp) {
     FreeBlockHeader *fp = (FreeBlockHeader *)bp;
-    return fp->next_free;
+    return from_offset(fp->next_free);
 }
 
 /**
@@ -142,7 +317,7 @@ static BlockHeader *get_next_free(BlockHeader *bp) {
  */
 static void set_prev_free(BlockHeader *bp, BlockHeader *prev) {
     FreeBlockHeader *fp = (FreeBlockHeader *)bp;
-    fp->prev_free = prev;
+    fp->prev_free = to_offset(prev);
 }
 
 /**
@@ -153,423 +328,2554 @@ static void set_prev_free(BlockHeader *bp, BlockHeader *prev) {
  */
 static void set_next_free(BlockHeader *bp, BlockHeader *next) {
     FreeBlockHeader *fp = (FreeBlockHeader *)bp;
-    fp->next_free = next;
+    fp->next_free = to_offset(next);
 }
 
-/* Pointer to the header of the first block on the heap */
-static BlockHeader *heap_blocks;
+/**
+ * Large free blocks are also nodes of a red-black tree ordered by size, then
+ * by address. The tree links are offsets like the free list links, stored in
+ * the payload after them (they are unused while the block is in the tree).
+ */
+typedef struct {
+    FreeBlockHeader free;
+    BlockOffset left;
+    BlockOffset right;
+    BlockOffset parent;
+    int red;
+} TreeBlockHeader;
+
+/**
+ * Read a link of a free block in the tree.
+ *
+ * @param bp address of a block header (it must be a free block in the tree)
+ * @return address of the header of the left child, right child or parent
+ */
+static BlockHeader *get_left(BlockHeader *bp) {
+    return from_offset(((TreeBlockHeader *)bp)->left);
+}
+
+static BlockHeader *get_right(BlockHeader *bp) {
+    return from_offset(((TreeBlockHeader *)bp)->right);
+}
 
-/* Pointers to the headers of the first and last blocks on the free list */
-static BlockHeader *free_headp;
-static BlockHeader *free_tailp;
+static BlockHeader *get_parent(BlockHeader *bp) {
+    return from_offset(((TreeBlockHeader *)bp)->parent);
+}
 
 /**
- * Add a block at the beginning of the free list.
+ * Set a link of a free block in the tree.
  *
- * @param bp address of the header of the block to add
+ * @param bp address of a free block header
+ * @param node address of the header of the left child, right child or parent
  */
-static void free_list_prepend(BlockHeader *bp) {
-    // TODO: implement
-    if((free_headp!=NULL) || (free_tailp!=NULL)){ //if there is element in the list
-        set_prev_free(bp,NULL); //set the previous for the newly added to null
-        set_next_free(bp,free_headp); //set the next for the newly added to head, which was the first
-        set_prev_free(free_headp,bp); //set the previous of the head to newly added block
-        free_headp = bp; //now the head is the newly added
-    }
-    else if((free_headp==NULL) && (free_tailp==NULL)) { //if there is no element in the list
-        set_prev_free(bp, NULL); //previous of bp is null
-        set_next_free(bp,NULL); //next of bp is nul
-        free_headp = bp; //head is bp
-        free_tailp = bp; //tail is bp
-    }
+static void set_left(BlockHeader *bp, BlockHeader *node) {
+    ((TreeBlockHeader *)bp)->left = to_offset(node);
+}
+
+static void set_right(BlockHeader *bp, BlockHeader *node) {
+    ((TreeBlockHeader *)bp)->right = to_offset(node);
+}
+
+static void set_parent(BlockHeader *bp, BlockHeader *node) {
+    ((TreeBlockHeader *)bp)->parent = to_offset(node);
 }
 
 /**
- * Add a block at the end of the free list.
+ * Read the color of a tree node; missing (`NULL`) children are black.
  *
- * @param bp address of the header of the block to add
+ * @param bp address of a free block header in the tree, or `NULL`
+ * @return 1 if red, 0 if black
  */
-static void free_list_append(BlockHeader *bp) {
-    // TODO: implement
-    if((free_headp!=NULL) || (free_tailp!=NULL)){ //if there is element in the list    
-        set_next_free(bp,NULL); //set next of the bp to null
-        set_next_free(free_tailp,bp); //set the next of the tail to bp
-        set_prev_free(bp,free_tailp); //set prev of the bp to tail
-        free_tailp = bp; //new tail is now bp
-    }
-    else if((free_headp==NULL) && (free_tailp==NULL)) { //if there is no element in the list
-        set_prev_free(bp, NULL);
-        set_next_free(bp,NULL);
-        free_headp = bp;
-        free_tailp = bp;
-    }
+static int is_red(BlockHeader *bp) {
+    return bp != NULL && ((TreeBlockHeader *)bp)->red;
 }
 
 /**
- * Remove a block from the free list.
+ * Set the color of a tree node.
  *
- * @param bp address of the header of the block to remove
+ * @param bp address of a free block header in the tree
+ * @param red 1 for red, 0 for black
  */
-static void free_list_remove(BlockHeader *bp) {
-    // TODO: implement
-    if((get_prev_free(bp)==NULL) && (get_next_free(bp)!=NULL)){ //if bp is the first block
-        set_prev_free(get_next_free(bp),NULL); //set previous of head to null
-        free_headp = get_next_free(bp); //head is the next of bp 
-        set_next_free(bp,NULL); //set next of bp to null 
-    }
-    else if((get_next_free(bp)==NULL) && (get_prev_free(bp)!=NULL)){ //if bp is tail
-        set_next_free(get_prev_free(bp), NULL); //set next of the previous block of bp to null because that block is now the tail
-        free_tailp = get_prev_free(bp); //set previous of the bp to tail
-        set_prev_free(bp,NULL);//set previous of bp to null
-    }
-    else if((get_prev_free(bp)==NULL) && (get_next_free(bp)==NULL)){ // if there is one block remaining
-        free_headp = NULL; //set head to null
-        free_tailp = NULL; //set tail to null
-        set_prev_free(bp,NULL); //set prev of bp to null
-        set_next_free(bp,NULL); //set next of bp to null
-    }
-    else if((get_prev_free(bp)!=NULL) && (get_next_free(bp)!=NULL)){ //if bp is not the first block
-        set_next_free(get_prev_free(bp),get_next_free(bp)); //connect previous block to next block of bp
-        set_prev_free(get_next_free(bp),get_prev_free(bp)); //connect next block to preivous block of bp
-    }
+static void set_red(BlockHeader *bp, int red) {
+    ((TreeBlockHeader *)bp)->red = red;
 }
 
 /**
- * Mark a block as free, coalesce with contiguous free blocks on the heap, add
- * the coalesced block to the free list.
+ * Free blocks of PURGE_MIN bytes or more also record when they were put on a
+ * free list, after the tree links, and while dirty (not purged) they are
+ * linked on the dirty list of their arena, oldest first. Whole pages after
+ * this header and before the footer can be purged: nothing writes there while
+ * the block is free.
+ */
+#define PURGE_MIN (16 * 1024)
+
+typedef struct {
+    TreeBlockHeader tree;
+    uint32_t freed_at;         // arena clock_ms when the block was inserted
+    BlockOffset dirty_prev;    // neighbors on the dirty list
+    BlockOffset dirty_next;
+} LargeFreeBlockHeader;
+
+/* Pointer to the header of the first block on the heap */
+static BlockHeader *heap_blocks;
+
+/**
+ * Free blocks are kept on segregated free lists. How a block size maps to a
+ * list, and how lists are searched, depends on the fit policy.
  *
- * @param bp address of the block to mark as free
- * @return the address of the coalesced block
+ * MM_POLICY_SEGFIT: blocks smaller than 128 bytes get an exact class for each
+ * multiple of ALIGNMENT; above that, every power of two is split into 4
+ * classes.
+ * Blocks of TREE_MIN bytes or more are kept in a red-black tree instead, which
+ * finds the best fit among them in O(log n).
+ *
+ * MM_POLICY_TLSF: a two-level segregated fit. The first level is the power of
+ * two of the size, the second level splits it linearly into 8 lists. A two
+ * level bitmap finds a non-empty list that is guaranteed to fit in O(1).
  */
-static BlockHeader *free_coalesce(BlockHeader *bp) {
-    // mark block as free
-    int size = get_size(bp);
-    set_header(bp, size, 0);
-    set_footer(bp, size, 0);
-    
-    int nextSize=0;
-    int prevSize=0;
-    int totalSize=0;
+#define SMALL_LIMIT 128        // first size handled by the power-of-two classes
+#define SMALL_CLASSES ((SMALL_LIMIT - MIN_BLOCK_SIZE) / ALIGNMENT)  // exact classes
+#define NUM_CLASSES (SMALL_CLASSES + 12)  // classes for sizes below TREE_MIN
+#define TREE_MIN 1024          // smallest block size kept in the tree
 
-    // check whether contiguous blocks are allocated
-    int prev_alloc = get_allocated(get_prev(bp));
-    int next_alloc = get_allocated(get_next(bp));
+#define TLSF_SL_LOG2 3                          // log2 of the second level lists
+#define TLSF_SL_COUNT (1 << TLSF_SL_LOG2)
+#define TLSF_FL_MIN 4                           // log2 of the smallest block
+#define TLSF_FL_COUNT (32 - TLSF_FL_MIN)        // sizes are below 2^32
+#define NUM_LISTS (TLSF_FL_COUNT * TLSF_SL_COUNT)
 
-    if (prev_alloc && next_alloc) { //surrounded by allocated
-        // TODO: add bp to free list
-        if(size<1000){ //added condition to separate when to prepend and when to append
-            free_list_prepend(bp); //prepend condition
-        }
-        else{
-            free_list_append(bp); //append condition
-        }
-        return bp;
+/* Policy used to index and search the free lists */
+static int fit_policy = MM_POLICY_SEGFIT;
 
-    } else if (prev_alloc && !next_alloc) { //when next is not allocated, coalesce with next
-        // TODO: remove next block from free list
-        free_list_remove(get_next(bp));
-        
-        // TODO: add bp to free list
-        if(size<1000){ //added condition 
-            free_list_prepend(bp); //prepend condition
-        }
-        else{
-            free_list_append(bp); //append condition
-        }
-        // TODO: coalesce with next block
-        nextSize = get_size(get_next(bp)); //get the size of the next 
-        totalSize = size+nextSize; //new block total size
-        set_header(bp, totalSize, 0); //set the header with new size, 0 for unallocated
-        set_footer(bp, totalSize, 0); //set footer with new size, 0 foir unallocated
-        return bp;
-    } 
-    else if (!prev_alloc && next_alloc) { //when prev is not allocated, coalesce with prev
-        // TODO: coalesce with previous block
-        prevSize = get_size(get_prev(bp)); //get size of the previous
-        totalSize = size+prevSize;  //get total size
-        //Don't have to add to the list just update header and footer 
-        set_header(get_prev(bp),totalSize,0); //set the header of the previous to new total size
-        set_footer(get_prev(bp),totalSize,0); //set the footer of the previous to new total size
-        return get_prev(bp);
-    }
-    else { //both are not allocated - then remove the next and update the header and footer of the previous
-        // TODO: remove next block from free list
-        free_list_remove(get_next(bp)); 
-        // TODO: coalesce with previous and next block
-        nextSize = get_size(get_next(bp)); //get size of next
-        prevSize = get_size(get_prev(bp)); //get size of prev
-        totalSize = prevSize+size+nextSize; //total size of the new block (prev+mysize+next)
-        set_header(get_prev(bp),totalSize,0); //set header of the previous to new total size
-        set_footer(get_prev(bp),totalSize,0); //set footer of the previous to new total size
-        return get_prev(bp);
+/**
+ * Requests below SLAB_LIMIT bytes that a slot holds in less space than a heap
+ * block (see slab_serves) are served from slab runs: RUN_SIZE bytes of the
+ * heap, aligned to RUN_SIZE from the start of the heap, split into slots of
+ * the same size. A run is an allocated block for the rest of the allocator;
+ * slots have no header, a bitmap in the run header tracks which ones are
+ * free, and page_map tells which heap pages are runs.
+ */
+#define SLAB_LIMIT 64                        // smallest size not served by runs
+#define SLAB_CLASSES (SLAB_LIMIT / ALIGNMENT)  // slot sizes ALIGNMENT, ..., 64
+#define RUN_SIZE 4096
+#define RUN_MAP_WORDS (RUN_SIZE / ALIGNMENT / 32)  // bits for the smallest slots
+
+typedef struct SlabRun {
+    struct SlabRun *prev;   // runs of the same class with free slots
+    struct SlabRun *next;
+    int slot_size;
+    int slot_count;
+    int free_count;
+    uint32_t free_map[RUN_MAP_WORDS];  // bit set when the slot is free
+} SlabRun;
+
+/* First byte of slot 0, rounded up to keep slots aligned */
+#define RUN_SLOTS_OFFSET \
+    (((int)sizeof(SlabRun) + ALIGNMENT - 1) / ALIGNMENT * ALIGNMENT)
+
+/**
+ * The heap is split into arenas, each with its own free lists, slab runs and
+ * locks, growing by chunks of memory from mem_sbrk. A thread is assigned an
+ * arena round-robin on its first call; blocks always go back to the arena they
+ * were carved from, found from page_map.
+ */
+#define MAX_ARENAS 64
+#define ARENA_CHUNK (64 * 1024)  // smallest chunk when there are several arenas
+
+typedef struct __attribute__((aligned(64))) {  // no false sharing of locks
+    Lock lock;
+
+    /* Pointers to the headers of the first and last blocks on each free list */
+    BlockHeader *free_heads[NUM_LISTS];
+    BlockHeader *free_tails[NUM_LISTS];
+
+    /* Bit i is set when the free list of size class i is not empty (segfit) */
+    uint64_t free_bitmap;
+
+    /* Root of the tree of free blocks of TREE_MIN bytes or more (segfit) */
+    BlockHeader *tree_root;
+
+    /* Bit i is set when first level i has a non-empty list (TLSF) */
+    uint32_t tlsf_fl_bitmap;
+
+    /* Bit j of entry i is set when list (i, j) is not empty (TLSF) */
+    uint8_t tlsf_sl_bitmap[TLSF_FL_COUNT];
+
+    /* Epilogue of the last chunk, the only one that can grow in place */
+    BlockHeader *epilogue;
+
+    /* Runs with at least one free slot, for each slot size, and their locks */
+    SlabRun *slab_partial[SLAB_CLASSES];
+    Lock slab_locks[SLAB_CLASSES];
+
+    /* Blocks freed by threads of other arenas, linked through their first
+     * word; pushed without locking and drained by the next allocation */
+    void *remote_frees;
+
+    /* Live threads bound to the arena; with none left, frees pushed on
+     * remote_frees are drained by the thread that pushes them */
+    int threads;
+
+    /* Clock of the arena in milliseconds, and frees since it was read */
+    uint32_t clock_ms;
+    int decay_ticks;
+
+    /* Dirty free blocks of PURGE_MIN bytes or more, by freed_at */
+    BlockHeader *dirty_head;
+    BlockHeader *dirty_tail;
+
+    /* Running totals for mm_stats, kept under the arena lock */
+    size_t heap_bytes;    // bytes of the blocks of its chunks
+    size_t free_bytes;    // bytes of its free blocks
+    size_t free_blocks;
+    size_t free_histogram[MM_STATS_BUCKETS];  // free blocks by power of two
+
+    int index;  // position in arenas, as stored in page_map
+} Arena;
+
+static Arena arenas[MAX_ARENAS] = {
+    [0 ... MAX_ARENAS - 1] = {
+        .lock = LOCK_INITIALIZER,
+        .slab_locks = { [0 ... SLAB_CLASSES - 1] = LOCK_INITIALIZER },
+    },
+};
+
+/* Number of arenas in use, set with MM_OPT_ARENAS */
+static int num_arenas = 1;
+
+/* Arena given to the next thread */
+static unsigned next_arena;
+
+/* Serializes mem_sbrk calls and the page_map entries of new chunks */
+static Lock chunk_lock = LOCK_INITIALIZER;
+
+/**
+ * One byte per RUN_SIZE page of the heap: the index of the arena owning the
+ * page, with PAGE_SLAB set when a run starts there. With a single arena only
+ * the PAGE_SLAB bits are written.
+ */
+#define PAGE_SLAB 0x80
+static unsigned char page_map[MAX_HEAP / RUN_SIZE];
+
+/* Number of page_map entries covering the heap since mm_init */
+static int page_map_used;
+
+/**
+ * Find the size class of a block.
+ *
+ * @param size block size in bytes (multiple of ALIGNMENT, at least
+ *        MIN_BLOCK_SIZE)
+ * @return index of the free list for blocks of this size
+ */
+static int size_class(size_t size) {
+    if (size < SMALL_LIMIT)
+        return (size - MIN_BLOCK_SIZE) / ALIGNMENT;  // one class per size
+    int log2 = 63 - __builtin_clzll(size);  // position of the highest set bit
+    int sub = (size >> (log2 - 2)) & 3;      // next 2 bits pick the sub-class
+    int cls = SMALL_CLASSES + (log2 - 7) * 4 + sub;
+    return MIN(cls, NUM_CLASSES - 1);
+}
+
+/**
+ * Find the TLSF list of a block.
+ *
+ * @param size block size in bytes (multiple of ALIGNMENT, below 2^32)
+ * @return index of the list, first level * TLSF_SL_COUNT + second level
+ */
+static int tlsf_index(size_t size) {
+    int fl = 63 - __builtin_clzll(size);                    // first level
+    int sl = (size >> (fl - TLSF_SL_LOG2)) & (TLSF_SL_COUNT - 1);  // second
+    return (fl - TLSF_FL_MIN) * TLSF_SL_COUNT + sl;
+}
+
+/**
+ * Find the free list holding blocks of a given size under the current policy.
+ *
+ * @param size block size in bytes
+ * @return index into free_heads/free_tails
+ */
+static int free_list_index(size_t size) {
+    if (fit_policy == MM_POLICY_TLSF)
+        return tlsf_index(size);
+    return size_class(size);
+}
+
+/**
+ * Record that a free list is not empty.
+ *
+ * @param arena arena of the block
+ * @param idx index of the free list
+ */
+static void free_list_mark(Arena *arena, int idx) {
+    if (fit_policy == MM_POLICY_TLSF) {
+        arena->tlsf_sl_bitmap[idx / TLSF_SL_COUNT] |= 1 << (idx % TLSF_SL_COUNT);
+        arena->tlsf_fl_bitmap |= 1u << (idx / TLSF_SL_COUNT);
+    } else {
+        arena->free_bitmap |= (uint64_t)1 << idx;
     }
 }
 
 /**
- * Extend the heap with a free block of `size` bytes (multiple of 8).
+ * Record that a free list became empty.
  *
- * @param size number of bytes to allocate (a multiple of 8)
- * @return pointer to the header of the new free block
+ * @param arena arena of the block
+ * @param idx index of the free list
  */
-static BlockHeader *extend_heap(int size) {
-    // bp points to the beginning of the new block
-    char *bp = mem_sbrk(size);
-    if ((long)bp == -1)
-        return NULL;
-    // write header over old epilogue, then the footer
-    BlockHeader *old_epilogue = (BlockHeader *)bp - 1;
-    set_header(old_epilogue, size, 0);
-    set_footer(old_epilogue, size, 0);
-    // write new epilogue
-    set_header(get_next(old_epilogue), 0, 1);
-    // merge new block with previous one if possible
-    return free_coalesce(old_epilogue);
+static void free_list_unmark(Arena *arena, int idx) {
+    if (fit_policy == MM_POLICY_TLSF) {
+        int fl = idx / TLSF_SL_COUNT;
+        arena->tlsf_sl_bitmap[fl] &= ~(1 << (idx % TLSF_SL_COUNT));
+        if (arena->tlsf_sl_bitmap[fl] == 0)
+            arena->tlsf_fl_bitmap &= ~(1u << fl);
+    } else {
+        arena->free_bitmap &= ~((uint64_t)1 << idx);
+    }
 }
 
-int mm_init(void) {
-    // init list of free blocks
-    free_headp = NULL;
-    free_tailp = NULL;
-    
-    // create empty heap of 4 x 4-byte words
-    char *new_region = mem_sbrk(16);
-    if ((long)new_region == -1)
-        return -1;
+/**
+ * Order of blocks in the tree: by size, then by address.
+ *
+ * @param a address of a block header
+ * @param b address of a block header
+ * @return nonzero if `a` comes before `b`
+ */
+static int tree_less(BlockHeader *a, BlockHeader *b) {
+    size_t a_size = get_size(a);
+    size_t b_size = get_size(b);
+    return a_size < b_size || (a_size == b_size && a < b);
+}
 
-    heap_blocks = (BlockHeader *)new_region;
-    set_header(heap_blocks, 0, 0);      // skip 4 bytes for alignment
-    set_header(heap_blocks + 1, 8, 1);  // allocate a block of 8 bytes as prologue
-    set_footer(heap_blocks + 1, 8, 1);
-    set_header(heap_blocks + 3, 0, 1);  // epilogue
-    heap_blocks += 1;                   // point to the prologue header
+/**
+ * Make `node` take the place of `old` as a child of `parent`.
+ *
+ * @param arena arena of the block
+ * @param parent parent of `old`, or `NULL` if `old` is the root
+ * @param old current child
+ * @param node new child (may be `NULL`)
+ */
+static void tree_replace_child(Arena *arena, BlockHeader *parent, BlockHeader *old, BlockHeader *node) {
+    if (parent == NULL)
+        arena->tree_root = node;
+    else if (get_left(parent) == old)
+        set_left(parent, node);
+    else
+        set_right(parent, node);
+}
 
-    // TODO: extend heap with an initial heap size
-    extend_heap(200);
-    return 0;
+/**
+ * Rotate the subtree rooted at `x` to the left (its right child goes up).
+ *
+ * @param arena arena of the block
+ * @param x root of the subtree
+ */
+static void tree_rotate_left(Arena *arena, BlockHeader *x) {
+    BlockHeader *y = get_right(x);
+    set_right(x, get_left(y));
+    if (get_left(y) != NULL)
+        set_parent(get_left(y), x);
+    set_parent(y, get_parent(x));
+    tree_replace_child(arena, get_parent(x), x, y);
+    set_left(y, x);
+    set_parent(x, y);
 }
 
-void mm_free(void *bp) {
-   // TODO: move back 4 bytes to find the block header, then free block
-    BlockHeader* blockH; //new pointer
-    blockH = (BlockHeader*)bp-1; //move back 4bytes
-    free_coalesce(blockH);
+/**
+ * Rotate the subtree rooted at `x` to the right (its left child goes up).
+ *
+ * @param arena arena of the block
+ * @param x root of the subtree
+ */
+static void tree_rotate_right(Arena *arena, BlockHeader *x) {
+    BlockHeader *y = get_left(x);
+    set_left(x, get_right(y));
+    if (get_right(y) != NULL)
+        set_parent(get_right(y), x);
+    set_parent(y, get_parent(x));
+    tree_replace_child(arena, get_parent(x), x, y);
+    set_right(y, x);
+    set_parent(x, y);
 }
 
 /**
- * Find a free block with size greater or equal to `size`.
+ * Add a free block to the tree of large free blocks.
  *
- * @param size minimum size of the free block
- * @return pointer to the header of a free block or `NULL` if free blocks are
- *         all smaller than `size`.
+ * @param arena arena of the block
+ * @param bp address of the header of the block to add
  */
-//BlockHeader* finder = free_headp;
-static BlockHeader *find_fit(int size) {
-    // TODO: implement
-    //First Fit// 
-    //Doesn't work
-    /* while(finder){
-        if(get_size(finder)>=size){
-            return finder;
-        }
-        finder = get_next_free(finder);
-    }*/
-    //faster
-    /*BlockHeader* ptr = free_tailp;
-    while(ptr){
-        int bSize = get_size(ptr);
-        if(bSize<size){
-            ptr = get_prev_free(ptr);
-        }
-        else if(get_size(ptr)>=size){
-            return ptr;
-        }
-    }*/
-    
-    //better fit
-    if(size>270){ //condition to split 
-        BlockHeader* hptr = free_tailp; //if the size is big start from the tail
-        while(hptr){ //loop to find 
-            int bSize = get_size(hptr); //get the size for comparison
-            //int min =1000000;
-            if(bSize>=size){ //check is big enough
-                if(get_prev_free(hptr)!=NULL){ //since starting from tail, check if there is block before
-                    //BlockHeader* bptr = (BlockHeader*)get_prev_free(hptr); 
-                    int nSize = get_size(get_prev_free(hptr)); //get the size of before block
-                    if(nSize<bSize && nSize>=size ){ //if the before block is large enough but smaller 
-                        return get_prev_free(hptr); //it is a better fit
-                    }
-                    else{
-                        return hptr;
-                    }
-                }
-                else{
-                    return hptr;
+static void tree_insert(Arena *arena, BlockHeader *bp) {
+    // walk down to the leaf position of bp
+    BlockHeader *parent = NULL;
+    BlockHeader *node = arena->tree_root;
+    while (node != NULL) {
+        parent = node;
+        node = tree_less(bp, node) ? get_left(node) : get_right(node);
+    }
+    set_parent(bp, parent);
+    set_left(bp, NULL);
+    set_right(bp, NULL);
+    set_red(bp, 1);
+    if (parent == NULL)
+        arena->tree_root = bp;
+    else if (tree_less(bp, parent))
+        set_left(parent, bp);
+    else
+        set_right(parent, bp);
+
+    // restore the red-black properties: no red node has a red parent
+    while (is_red(get_parent(bp))) {
+        BlockHeader *p = get_parent(bp);
+        BlockHeader *g = get_parent(p);  // exists, the root is black
+        if (p == get_left(g)) {
+            BlockHeader *uncle = get_right(g);
+            if (is_red(uncle)) {         // recolor and move up
+                set_red(p, 0);
+                set_red(uncle, 0);
+                set_red(g, 1);
+                bp = g;
+            } else {
+                if (bp == get_right(p)) {
+                    bp = p;
+                    tree_rotate_left(arena, bp);
+                    p = get_parent(bp);
                 }
-                //min = MIN(bSize,min);
+                set_red(p, 0);
+                set_red(g, 1);
+                tree_rotate_right(arena, g);
             }
-            else if(bSize<size){ //traverse
-                hptr = get_prev_free(hptr);
+        } else {
+            BlockHeader *uncle = get_left(g);
+            if (is_red(uncle)) {
+                set_red(p, 0);
+                set_red(uncle, 0);
+                set_red(g, 1);
+                bp = g;
+            } else {
+                if (bp == get_left(p)) {
+                    bp = p;
+                    tree_rotate_right(arena, bp);
+                    p = get_parent(bp);
+                }
+                set_red(p, 0);
+                set_red(g, 1);
+                tree_rotate_left(arena, g);
             }
         }
     }
-    else if(size<=270){ //start from the head
-        BlockHeader* hptr = free_headp; 
-        while(hptr){
-            int bSize = get_size(hptr); //get the size
-            //int min =1000000;
-            if(bSize>=size){ //if the size is large enough
-                if(get_next_free(hptr)!=NULL){ //since starting from head, check if it is not the last
-                    //BlockHeader* bptr = (BlockHeader*)get_prev_free(hptr); 
-                    int nSize = get_size(get_next_free(hptr)); //get the size of one after
-                    if(nSize<bSize && nSize>=size ){ //check if size is big and smaller  
-                        return get_next_free(hptr); //better fit
-                    }
-                    else{
-                        return hptr;
-                    }
-                }
-                else{
-                    return hptr;
+    set_red(arena->tree_root, 0);
+}
+
+/**
+ * Restore the red-black properties after removing a black node.
+ *
+ * @param arena arena of the block
+ * @param x node that replaced the removed one (may be `NULL`)
+ * @param parent parent of `x`
+ */
+static void tree_remove_fixup(Arena *arena, BlockHeader *x, BlockHeader *parent) {
+    while (x != arena->tree_root && !is_red(x)) {
+        if (x == get_left(parent)) {
+            BlockHeader *w = get_right(parent);  // sibling, never NULL here
+            if (is_red(w)) {
+                set_red(w, 0);
+                set_red(parent, 1);
+                tree_rotate_left(arena, parent);
+                w = get_right(parent);
+            }
+            if (!is_red(get_left(w)) && !is_red(get_right(w))) {
+                set_red(w, 1);
+                x = parent;
+                parent = get_parent(x);
+            } else {
+                if (!is_red(get_right(w))) {
+                    set_red(get_left(w), 0);
+                    set_red(w, 1);
+                    tree_rotate_right(arena, w);
+                    w = get_right(parent);
                 }
-                //min = MIN(bSize,min);
+                set_red(w, is_red(parent));
+                set_red(parent, 0);
+                set_red(get_right(w), 0);
+                tree_rotate_left(arena, parent);
+                x = arena->tree_root;
             }
-            else if(bSize<size){
-                hptr = get_next_free(hptr); //traverse
+        } else {
+            BlockHeader *w = get_left(parent);
+            if (is_red(w)) {
+                set_red(w, 0);
+                set_red(parent, 1);
+                tree_rotate_right(arena, parent);
+                w = get_left(parent);
+            }
+            if (!is_red(get_left(w)) && !is_red(get_right(w))) {
+                set_red(w, 1);
+                x = parent;
+                parent = get_parent(x);
+            } else {
+                if (!is_red(get_left(w))) {
+                    set_red(get_right(w), 0);
+                    set_red(w, 1);
+                    tree_rotate_left(arena, w);
+                    w = get_left(parent);
+                }
+                set_red(w, is_red(parent));
+                set_red(parent, 0);
+                set_red(get_left(w), 0);
+                tree_rotate_right(arena, parent);
+                x = arena->tree_root;
             }
         }
-    }      
-    return NULL; //return null when can not find.
+    }
+    if (x != NULL)
+        set_red(x, 0);
 }
 
 /**
- * Allocate a block of `size` bytes inside the given free block `bp`.
+ * Remove a free block from the tree of large free blocks.
  *
- * @param bp pointer to the header of a free block of at least `size` bytes
- * @param size bytes to assign as an allocated block (multiple of 8)
- * @return pointer to the header of the allocated block
+ * @param arena arena of the block
+ * @param bp address of the header of the block to remove
  */
-static BlockHeader *place(BlockHeader *bp, int size) {
-    // TODO: if current size is greater, use part and add rest to free list
-    int newSize = get_size(bp)-size; //new remaining size to put in free list
-    free_list_remove(bp); //remove bp from freelist
-    if(newSize<=8){
-        //if size is too small for freelist
-        set_header(bp,get_size(bp),1); //use all of the size to allocate
-        set_footer(bp,get_size(bp),1);
-    }
-    else{
-        if(size>25){ //check if size is greater than 25 than put it at the back 
-            //back
-            set_header(bp,newSize,0); //set new size and 0
-            set_footer(bp,newSize,0); //set new size and 0
-            set_header(get_next(bp),size,1); //getnext of bp and set allocated to size
-            set_footer(get_next(bp),size,1); //set to allocated with size
-            free_coalesce(bp); //check to coalsce
-            return get_next(bp);
+static void tree_remove(Arena *arena, BlockHeader *bp) {
+    BlockHeader *x;       // node moving into the removed position
+    BlockHeader *parent;  // parent of x after the removal
+    int removed_red;
+
+    if (get_left(bp) == NULL || get_right(bp) == NULL) {
+        // at most one child: it replaces bp
+        x = get_left(bp) != NULL ? get_left(bp) : get_right(bp);
+        parent = get_parent(bp);
+        removed_red = is_red(bp);
+        if (x != NULL)
+            set_parent(x, parent);
+        tree_replace_child(arena, parent, bp, x);
+    } else {
+        // two children: the successor y (no left child) replaces bp
+        BlockHeader *y = get_right(bp);
+        while (get_left(y) != NULL)
+            y = get_left(y);
+        x = get_right(y);
+        removed_red = is_red(y);
+        if (get_parent(y) == bp) {
+            parent = y;
+        } else {
+            parent = get_parent(y);
+            if (x != NULL)
+                set_parent(x, parent);
+            set_left(parent, x);
+            set_right(y, get_right(bp));
+            set_parent(get_right(y), y);
         }
-        else if(size<=25){ //check if size is less than 25 than put it at the front
-            //front
-            set_header(bp,size,1); //set allocated with size
-            set_footer(bp,size,1); //set allocated with size
-            set_header(get_next(bp),newSize,0); //getnext of bp is the remaining block so set header
-            set_footer(get_next(bp),newSize,0); //set footer of getnext of bp
-            free_coalesce(get_next(bp)); //check to coalsce
-            return bp;
+        set_left(y, get_left(bp));
+        set_parent(get_left(y), y);
+        set_parent(y, get_parent(bp));
+        tree_replace_child(arena, get_parent(bp), bp, y);
+        set_red(y, is_red(bp));
+    }
+    if (!removed_red)
+        tree_remove_fixup(arena, x, parent);
+}
+
+/**
+ * Find the smallest block in the tree with size greater or equal to `size`.
+ *
+ * @param arena arena of the block
+ * @param size minimum size of the free block
+ * @return pointer to the header of the best fit or `NULL`
+ */
+static BlockHeader *tree_best_fit(Arena *arena, size_t size) {
+    BlockHeader *best = NULL;
+    BlockHeader *node = arena->tree_root;
+    while (node != NULL) {
+        if (get_size(node) >= size) {
+            best = node;            // fits: look for a smaller one on the left
+            node = get_left(node);
+        } else {
+            node = get_right(node);
         }
     }
-    return bp;
+    return best;
 }
 
 /**
- * Compute the required block size (including space for header/footer) from the
- * requested payload size.
+ * Add a block at the beginning of the free list for its size class.
  *
- * @param payload_size requested payload size
- * @return a block size including header/footer that is a multiple of 8
+ * @param arena arena of the block
+ * @param bp address of the header of the block to add
  */
-static int required_block_size(int payload_size) {
-    payload_size += 8;                    // add 8 for for header/footer
-    return ((payload_size + 7) / 8) * 8;  // round up to multiple of 8
+static void free_list_prepend(Arena *arena, BlockHeader *bp) {
+    int cls = free_list_index(get_size(bp));
+    set_prev_free(bp, NULL);              // bp becomes the first block
+    set_next_free(bp, arena->free_heads[cls]);   // followed by the old head
+    if (arena->free_heads[cls] != NULL)
+        set_prev_free(arena->free_heads[cls], bp);
+    else
+        arena->free_tails[cls] = bp;             // list was empty: bp is also the tail
+    arena->free_heads[cls] = bp;
+    free_list_mark(arena, cls);
 }
 
-void *mm_malloc(size_t size) {
-    // ignore spurious requests
-    if (size == 0)
-        return NULL;
+/**
+ * Count a block entering or leaving the free lists.
+ *
+ * @param arena arena of the block
+ * @param size block size
+ * @param delta 1 when the block becomes free, -1 when it is taken
+ */
+static void free_stats_update(Arena *arena, size_t size, int delta) {
+    arena->free_bytes += delta * (intptr_t)size;
+    arena->free_blocks += delta;
+    arena->free_histogram[63 - __builtin_clzll(size)] += delta;
+}
 
-    int required_size = required_block_size(size);
+/**
+ * Read the clock of an arena.
+ *
+ * @param arena arena to update
+ */
+static void arena_clock(Arena *arena) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    arena->clock_ms = now.tv_sec * 1000 + now.tv_nsec / 1000000;
+}
 
-    // TODO: find a free block or extend heap
-    if(find_fit(required_size)){ //if findfit return other than null
-        // TODO: allocate and return pointer to payload
-        return get_payload_addr(place(find_fit(required_size),required_size)); //place it and return address
-    }
-    else if(!find_fit(required_size)){//if I need to extend heap, when findfit returned null
-        while(1){ //loop until find fit finds a adequate size
-            extend_heap(required_size);
-            if(find_fit(required_size)){ //if findfit returned other than null
-                // TODO: allocate and return pointer to payload
-                return get_payload_addr(place(find_fit(required_size),required_size));
-            }
-        }
-    }
-    return NULL;
+/**
+ * Add a large free block at the end of the dirty list, stamped with a fresh
+ * reading of the clock: the arena clock never goes back, so the list stays
+ * ordered by freed_at.
+ *
+ * @param arena arena of the block
+ * @param bp address of the header of a dirty block of PURGE_MIN bytes or more
+ */
+static void dirty_list_append(Arena *arena, BlockHeader *bp) {
+    LargeFreeBlockHeader *lp = (LargeFreeBlockHeader *)bp;
+    arena_clock(arena);
+    lp->freed_at = arena->clock_ms;  // dirty from now
+    lp->dirty_prev = to_offset(arena->dirty_tail);
+    lp->dirty_next = to_offset(NULL);
+    if (arena->dirty_tail != NULL)
+        ((LargeFreeBlockHeader *)arena->dirty_tail)->dirty_next = to_offset(bp);
+    else
+        arena->dirty_head = bp;
+    arena->dirty_tail = bp;
 }
 
-void *mm_realloc(void *ptr, size_t size) { 
-    BlockHeader* hptr = (BlockHeader*)ptr-1; //set header
-    size_t rSize = required_block_size(size); // get the required block size
-    size_t size_block=get_size(hptr); //get size using the header 
-    size_t sSize = size_block - rSize; // size of the subtracted
-    size_t aSize = get_size(hptr) + get_size(get_next(hptr)); //add the neighboring size
-    size_t newSize = aSize - rSize;
-    if (hptr == NULL) {
-        // equivalent to malloc
-        return mm_malloc(size);
-    }else if (size == 0) {
-        // equivalent to free
-        mm_free(hptr);
+/**
+ * Remove a large free block from the dirty list.
+ *
+ * @param arena arena of the block
+ * @param bp address of the header of a block on the dirty list
+ */
+static void dirty_list_remove(Arena *arena, BlockHeader *bp) {
+    LargeFreeBlockHeader *lp = (LargeFreeBlockHeader *)bp;
+    BlockHeader *prev = from_offset(lp->dirty_prev);
+    BlockHeader *next = from_offset(lp->dirty_next);
+    if (prev != NULL)
+        ((LargeFreeBlockHeader *)prev)->dirty_next = lp->dirty_next;
+    else
+        arena->dirty_head = next;
+    if (next != NULL)
+        ((LargeFreeBlockHeader *)next)->dirty_prev = lp->dirty_prev;
+    else
+        arena->dirty_tail = prev;
+}
+
+/**
+ * Add a block at the end of the free list for its size class.
+ *
+ * @param arena arena of the block
+ * @param bp address of the header of the block to add
+ */
+static void free_list_append(Arena *arena, BlockHeader *bp) {
+    int cls = free_list_index(get_size(bp));
+    set_next_free(bp, NULL);              // bp becomes the last block
+    set_prev_free(bp, arena->free_tails[cls]);   // preceded by the old tail
+    if (arena->free_tails[cls] != NULL)
+        set_next_free(arena->free_tails[cls], bp);
+    else
+        arena->free_heads[cls] = bp;             // list was empty: bp is also the head
+    arena->free_tails[cls] = bp;
+    free_list_mark(arena, cls);
+}
+
+/**
+ * Remove a block from the free list for its size class (or from the tree).
+ *
+ * The block header must still hold the size used when the block was added.
+ *
+ * @param arena arena of the block
+ * @param bp address of the header of the block to remove
+ */
+static void free_list_remove(Arena *arena, BlockHeader *bp) {
+    free_stats_update(arena, get_size(bp), -1);
+    if (get_size(bp) >= PURGE_MIN && !get_purged(bp))
+        dirty_list_remove(arena, bp);
+    if (fit_policy == MM_POLICY_SEGFIT && get_size(bp) >= TREE_MIN) {
+        tree_remove(arena, bp);
+        return;
+    }
+    int cls = free_list_index(get_size(bp));
+    BlockHeader *prev = get_prev_free(bp);
+    BlockHeader *next = get_next_free(bp);
+    if (prev != NULL)
+        set_next_free(prev, next);        // unlink from the previous block
+    else
+        arena->free_heads[cls] = next;           // bp was the head
+    if (next != NULL)
+        set_prev_free(next, prev);        // unlink from the next block
+    else
+        arena->free_tails[cls] = prev;           // bp was the tail
+    if (arena->free_heads[cls] == NULL)
+        free_list_unmark(arena, cls);            // list is now empty
+    set_prev_free(bp, NULL);
+    set_next_free(bp, NULL);
+}
+
+/**
+ * Add a free block to the free list of its size class. Blocks below TREE_MIN
+ * go to the front of their list, to be reused while their lines are still
+ * cached; larger blocks, listed only under TLSF (segfit keeps them in the
+ * tree), go to the back.
+ *
+ * @param arena arena of the block
+ * @param bp address of the header of the block to add
+ */
+static void free_list_insert(Arena *arena, BlockHeader *bp) {
+    free_stats_update(arena, get_size(bp), 1);
+    if (get_size(bp) >= PURGE_MIN && !get_purged(bp))
+        dirty_list_append(arena, bp);
+    if (fit_policy == MM_POLICY_SEGFIT && get_size(bp) >= TREE_MIN)
+        tree_insert(arena, bp);
+    else if (get_size(bp) < TREE_MIN)
+        free_list_prepend(arena, bp);
+    else
+        free_list_append(arena, bp);
+}
+
+/**
+ * Mark a block as free, coalesce with contiguous free blocks on the heap, add
+ * the coalesced block to the free list.
+ *
+ * @param arena arena of the block
+ * @param bp address of the block to mark as free
+ * @return the address of the coalesced block
+ */
+static BlockHeader *free_coalesce(Arena *arena, BlockHeader *bp) {
+    // mark block as free, and tell the next block it now has a footer
+    size_t size = get_size(bp);
+    set_header(bp, size, 0);
+    set_footer(bp, size, 0);
+    set_prev_allocated(get_next(bp), 0);
+
+    // check whether contiguous blocks are allocated
+    int prev_alloc = get_prev_allocated(bp);
+    int next_alloc = get_allocated(get_next(bp));
+    // a merged block must still fit in a header: leave such neighbors apart
+    if (!next_alloc && size + get_size(get_next(bp)) > MAX_BLOCK_SIZE)
+        next_alloc = 1;
+    if (!prev_alloc && size + get_size(get_prev(bp)) +
+            (next_alloc ? 0 : get_size(get_next(bp))) > MAX_BLOCK_SIZE)
+        prev_alloc = 1;
+
+    if (prev_alloc && next_alloc) { //surrounded by allocated
+        free_list_insert(arena, bp);
+        return bp;
+
+    } else if (prev_alloc && !next_alloc) { //when next is not allocated, coalesce with next
+        BlockHeader *next = get_next(bp);
+        free_list_remove(arena, next); //must happen before the sizes change
+        size += get_size(next);
+        set_header(bp, size, 0); //set the header with new size, 0 for unallocated
+        set_footer(bp, size, 0); //set footer with new size, 0 for unallocated
+        free_list_insert(arena, bp); //the merged block may belong to a different class
+        return bp;
+    }
+    else if (!prev_alloc && next_alloc) { //when prev is not allocated, coalesce with prev
+        BlockHeader *prev = get_prev(bp);
+        free_list_remove(arena, prev); //prev grows, so it has to move to its new class
+        size += get_size(prev);
+        set_header(prev, size, 0); //set the header of the previous to new total size
+        set_footer(prev, size, 0); //set the footer of the previous to new total size
+        free_list_insert(arena, prev);
+        return prev;
+    }
+    else { //both are not allocated - remove both neighbors and merge them into the previous
+        BlockHeader *prev = get_prev(bp);
+        BlockHeader *next = get_next(bp);
+        free_list_remove(arena, prev);
+        free_list_remove(arena, next);
+        size += get_size(prev) + get_size(next); //total size of the new block (prev+mysize+next)
+        set_header(prev, size, 0); //set header of the previous to new total size
+        set_footer(prev, size, 0); //set footer of the previous to new total size
+        free_list_insert(arena, prev);
+        return prev;
+    }
+}
+
+/**
+ * Allocation counts for mm_stats. Cache hits take no lock, so each thread
+ * counts its own allocations, in the current heap, and mm_stats sums the
+ * counts of all threads; those of exited threads are kept in retired_stats.
+ */
+typedef struct AllocStats {
+    size_t requested_total;  // payload bytes asked for, ever
+    size_t placed_total;     // bytes of the blocks, slots or mappings used, ever
+    struct AllocStats *prev; // threads with counts, linked under stats_lock
+    struct AllocStats *next;
+    int linked;
+} AllocStats;
+
+static __thread AllocStats alloc_stats;
+static AllocStats *alloc_stats_list;
+static AllocStats retired_stats;
+static Lock stats_lock = LOCK_INITIALIZER;
+
+static void count_allocation(size_t requested, size_t placed);
+
+/**
+ * Per-thread caches of freed blocks. mm_free pushes small blocks here and
+ * mm_malloc pops them without taking any lock; cached blocks stay marked
+ * allocated in the heap. Bins 0..SLAB_CLASSES-1 hold slab slots by slot size,
+ * the following bins hold heap blocks up to TCACHE_LIMIT bytes by block size.
+ */
+#define TCACHE_LIMIT 512   // largest heap block kept in a cache
+#define TCACHE_BINS (SLAB_CLASSES + (TCACHE_LIMIT - MIN_BLOCK_SIZE) / ALIGNMENT + 1)
+
+typedef struct {
+    void *heads[TCACHE_BINS];  // cached payloads, linked through their first word
+    int counts[TCACHE_BINS];
+    unsigned epoch;            // heap_epoch when the cache was last emptied
+    Arena *arena;              // arena of this thread, chosen on first use
+} ThreadCache;
+
+static __thread ThreadCache tcache;
+
+/* Blocks a bin may hold before half of them are flushed, 0 disables caching */
+static int tcache_high = 8;
+
+/* Bumped by mm_init, so that caches of a previous heap are dropped */
+static unsigned heap_epoch;
+
+/**
+ * Extend an arena with a free block of at least `size` bytes. The block
+ * continues the last chunk of the arena if that chunk ends at the break;
+ * otherwise it starts a new chunk, with padding and a prologue block before it
+ * so that the next payload is aligned, and an epilogue after it. With several
+ * arenas, chunks are made of whole page_map pages.
+ *
+ * A free block at the end of a continued chunk merges with the new memory, so
+ * only the bytes it lacks are added; if it is large enough already, the heap
+ * does not grow at all.
+ *
+ * @param arena arena of the block
+ * @param size number of bytes to allocate (a multiple of ALIGNMENT)
+ * @return pointer to the header of a free block of at least `size` bytes
+ */
+static BlockHeader *extend_heap(Arena *arena, size_t size) {
+    lock(&chunk_lock);
+    int contiguous = arena->epilogue != NULL &&
+            (char *)(arena->epilogue + 1) == (char *)mem_heap_hi() + 1;
+    size_t tail_size = 0;  // free block before the epilogue
+    if (contiguous && !get_prev_allocated(arena->epilogue)) {
+        BlockHeader *tail = get_prev(arena->epilogue);
+        tail_size = get_size(tail);
+        if (tail_size >= size) {
+            unlock(&chunk_lock);
+            return tail;  // missed by the search, which rounds up the size
+        }
+    }
+    // rounding below adds less than ARENA_CHUNK + RUN_SIZE; a merge that would
+    // pass MAX_BLOCK_SIZE does not happen, so the new block must fit alone
+    if (tail_size + size + ARENA_CHUNK + RUN_SIZE > MAX_BLOCK_SIZE)
+        tail_size = 0;
+    size_t incr = contiguous ? MAX(size - tail_size, MIN_BLOCK_SIZE) : size + 2 * ALIGNMENT;
+    if (num_arenas > 1)
+        incr = (MAX(incr, ARENA_CHUNK) + RUN_SIZE - 1) / RUN_SIZE * RUN_SIZE;
+    // bp points to the beginning of the new memory
+    char *bp = mem_sbrk(incr);
+    if ((long)bp == -1) {
+        unlock(&chunk_lock);
+        return NULL;
+    }
+    if (num_arenas > 1)
+        memset(page_map + (bp - heap_base) / RUN_SIZE, arena->index, incr / RUN_SIZE);
+    page_map_used = MAX(page_map_used, (int)((mem_heapsize() + RUN_SIZE - 1) / RUN_SIZE));
+    unlock(&chunk_lock);
+
+    BlockHeader *block;
+    if (contiguous) {
+        block = (BlockHeader *)bp - 1;  // write header over old epilogue
+    } else {
+        BlockHeader *prologue = (BlockHeader *)(bp + ALIGNMENT) - 1;  // skip padding
+        *prologue = 0;
+        set_header(prologue, ALIGNMENT, 1);  // allocate the prologue
+        set_prev_allocated(prologue, 1);     // nothing to coalesce before it
+        block = get_next(prologue);
+        *block = 0;
+        set_prev_allocated(block, 1);
+        incr -= 2 * ALIGNMENT;
+    }
+    arena->heap_bytes += incr;
+    set_header(block, incr, 0);
+    set_footer(block, incr, 0);
+    // write new epilogue, after a free block
+    arena->epilogue = get_next(block);
+    set_header(arena->epilogue, 0, 1);
+    set_prev_allocated(arena->epilogue, 0);
+    // merge new block with previous one if possible
+    return free_coalesce(arena, block);
+}
+
+/* Free bytes at the top of the heap that trigger a trim, 0 disables trimming */
+static size_t trim_threshold = 128 * 1024;
+
+/**
+ * Give the free block at the top of the heap back to memlib, in whole
+ * RUN_SIZE pages, when it is larger than trim_threshold. Only the last chunk
+ * of an arena can shrink, and only while it ends at the break. The epilogue
+ * is rewritten below the remaining free space, as extend_heap does.
+ *
+ * @param arena arena of the block
+ * @param bp address of the header of a coalesced free block
+ */
+static void heap_trim(Arena *arena, BlockHeader *bp) {
+    size_t size = get_size(bp);
+    if (trim_threshold == 0 || size <= trim_threshold || get_next(bp) != arena->epilogue)
+        return;
+    size_t trim = size / RUN_SIZE * RUN_SIZE;
+    if (size - trim > 0 && size - trim < MIN_BLOCK_SIZE)
+        trim -= RUN_SIZE;  // what stays must hold a free block
+    if (trim == 0)
+        return;
+
+    lock(&chunk_lock);
+    if ((char *)(arena->epilogue + 1) != (char *)mem_heap_hi() + 1) {
+        unlock(&chunk_lock);
+        return;
+    }
+    // unlink first: the links of bp can be in the pages given back, which
+    // read as zero once the break is lowered
+    free_list_remove(arena, bp);
+    if ((long)mem_sbrk(-(intptr_t)trim) == -1) {
+        unlock(&chunk_lock);
+        free_list_insert(arena, bp);
+        return;
+    }
+    unlock(&chunk_lock);
+    arena->heap_bytes -= trim;
+
+    size -= trim;
+    if (size > 0) {
+        set_header(bp, size, 0);
+        set_footer(bp, size, 0);
+        free_list_insert(arena, bp);
+        arena->epilogue = get_next(bp);
+        set_header(arena->epilogue, 0, 1);
+        set_prev_allocated(arena->epilogue, 0);
+    } else {
+        arena->epilogue = bp;  // follows an allocated block, like bp did
+        set_header(arena->epilogue, 0, 1);
+    }
+}
+
+/* Milliseconds a large free block stays dirty before it is purged, -1 = never */
+static long decay_ms = 1000;
+
+/* Frees and heap allocations between two decay checks */
+#define DECAY_CHECK 256
+
+/* Size of the pages of mappings, and of the heap pages that can be purged
+ * (huge pages, when memlib backs the heap with them) */
+static size_t page_size;
+static size_t purge_page_size;
+
+/**
+ * Find the whole pages inside a large free block that can be purged.
+ *
+ * @param bp address of the header of a free block of PURGE_MIN bytes or more
+ * @param start receives the first byte of the pages
+ * @param end receives the end of the pages (equal to *start if there are none)
+ */
+static void purge_range(BlockHeader *bp, char **start, char **end) {
+    uintptr_t first = (uintptr_t)bp + sizeof(LargeFreeBlockHeader);
+    uintptr_t last = (uintptr_t)bp + get_size(bp) - 4;  // the footer
+    first = (first + purge_page_size - 1) / purge_page_size * purge_page_size;
+    last = last / purge_page_size * purge_page_size;
+    *start = (char *)first;
+    *end = (char *)MAX(first, last);
+}
+
+/**
+ * Every DECAY_CHECK frees and heap allocations, read the clock and purge the
+ * large free blocks that stayed dirty for decay_ms, like jemalloc's dirty page decay. Purging
+ * lazily keeps short-lived free blocks from paying for madvise and page
+ * faults. Only the old end of the dirty list is visited, so a check that
+ * purges nothing costs one comparison.
+ *
+ * @param arena arena that freed or allocated a block, locked
+ */
+static void heap_decay(Arena *arena) {
+    if (decay_ms < 0 || ++arena->decay_ticks < DECAY_CHECK)
+        return;
+    arena->decay_ticks = 0;
+    arena_clock(arena);
+
+    BlockHeader *bp;
+    while ((bp = arena->dirty_head) != NULL &&
+            arena->clock_ms - ((LargeFreeBlockHeader *)bp)->freed_at >= (uint32_t)decay_ms) {
+        dirty_list_remove(arena, bp);
+        char *start, *end;
+        purge_range(bp, &start, &end);
+        if (end > start)
+            mem_purge(start, end - start);
+        set_purged(bp);
+    }
+}
+
+/**
+ * Free a block: coalesce it with its neighbors, trim the top of the heap and
+ * let dirty pages decay.
+ *
+ * @param arena arena of the block
+ * @param bp address of the header of the block
+ */
+static void free_block(Arena *arena, BlockHeader *bp) {
+    heap_trim(arena, free_coalesce(arena, bp));
+    heap_decay(arena);
+}
+
+/**
+ * Requests of mmap_threshold bytes or more bypass the heap: each gets its own
+ * mapping from memlib, with the mapping size in the ALIGNMENT bytes before the
+ * payload. They are told apart from heap blocks by their address, outside the
+ * heap reservation, and are not limited to MAX_BLOCK_SIZE.
+ */
+static size_t mmap_threshold = 256 * 1024;
+static size_t mapped_bytes;  // total size of the mappings, for mm_stats
+static size_t mapped_count;
+
+/**
+ * Compiled with -DMM_LATENCY, every public call is timed into a histogram of
+ * its operation and request size class. Histograms are log-linear, as in HDR
+ * histograms: each power of two is split in LATENCY_SUB buckets, so a bucket
+ * bounds a latency within 25%. Counters are shared by all threads.
+ */
+#ifdef MM_LATENCY
+#define LATENCY_SUB_BITS 2
+#define LATENCY_SUB (1 << LATENCY_SUB_BITS)
+
+static uint64_t latency[MM_NUM_OPS][MM_LATENCY_CLASSES][MM_LATENCY_BUCKETS];
+static int latency_fd = -1;  // where the histograms go at exit
+static int latency_registered;
+
+static void latency_exit(void) {
+    if (latency_fd >= 0)
+        mm_latency_dump(latency_fd);
+}
+#endif
+
+int mm_setopt(int option, long value) {
+    switch (option) {
+    case MM_OPT_POLICY:
+        if (value != MM_POLICY_SEGFIT && value != MM_POLICY_TLSF)
+            return -1;
+        fit_policy = value;
+        return 0;
+    case MM_OPT_TCACHE:
+        if (value < 0 || value > INT_MAX)
+            return -1;
+        tcache_high = value;
+        return 0;
+    case MM_OPT_ARENAS:
+        if (value < 1 || value > MAX_ARENAS)
+            return -1;
+        num_arenas = value;
+        return 0;
+    case MM_OPT_DECAY_MS:
+        decay_ms = value < 0 ? -1 : value;
+        return 0;
+    case MM_OPT_MMAP_THRESHOLD:
+        if (value < SLAB_LIMIT)
+            return -1;  // slots never move to mappings
+        mmap_threshold = value;
+        return 0;
+    case MM_OPT_TRIM_THRESHOLD:
+        if (value < 0)
+            return -1;
+        trim_threshold = value;
+        return 0;
+#ifdef MM_LATENCY
+    case MM_OPT_LATENCY_DUMP:
+        if (value > INT_MAX)
+            return -1;
+        if (value >= 0 && !latency_registered) {
+            if (atexit(latency_exit) != 0)
+                return -1;
+            latency_registered = 1;
+        }
+        latency_fd = value < 0 ? -1 : value;
+        return 0;
+#endif
+    default:
+        return -1;
+    }
+}
+
+int mm_init(void) {
+    for (int a = 0; a < num_arenas; a++) {
+        Arena *arena = &arenas[a];
+        arena->index = a;
+        arena->epilogue = NULL;  // no chunk yet
+        arena->remote_frees = NULL;
+        arena->threads = 0;  // threads rebind on their first call
+
+        // init lists of free blocks
+        for (int i = 0; i < NUM_LISTS; i++) {
+            arena->free_heads[i] = NULL;
+            arena->free_tails[i] = NULL;
+        }
+        arena->free_bitmap = 0;
+        arena->tree_root = NULL;
+        arena->tlsf_fl_bitmap = 0;
+        for (int i = 0; i < TLSF_FL_COUNT; i++)
+            arena->tlsf_sl_bitmap[i] = 0;
+
+        // forget runs from a previous heap
+        for (int i = 0; i < SLAB_CLASSES; i++)
+            arena->slab_partial[i] = NULL;
+
+        arena->heap_bytes = 0;
+        arena->free_bytes = 0;
+        arena->free_blocks = 0;
+        memset(arena->free_histogram, 0, sizeof(arena->free_histogram));
+
+        arena->dirty_head = NULL;
+        arena->dirty_tail = NULL;
+        // blocks freed from now on are stamped with a current time
+        arena->decay_ticks = 0;
+        arena_clock(arena);
+    }
+    memset(page_map, 0, page_map_used);
+    page_map_used = 0;
+    next_arena = 0;
+    page_size = mem_pagesize();
+    purge_page_size = mem_heap_pagesize();
+    heap_epoch++;  // thread caches hold blocks of the old heap
+    lock(&stats_lock);
+    retired_stats.requested_total = retired_stats.placed_total = 0;
+    for (AllocStats *st = alloc_stats_list; st != NULL; st = st->next) {
+        __atomic_store_n(&st->requested_total, 0, __ATOMIC_RELAXED);
+        __atomic_store_n(&st->placed_total, 0, __ATOMIC_RELAXED);
+    }
+    unlock(&stats_lock);
+#ifdef MM_LATENCY
+    memset(latency, 0, sizeof(latency));  // histograms cover one heap
+#endif
+
+    // the first chunk of arena 0 starts the heap
+    heap_base = mem_heap_lo();
+    if (extend_heap(&arenas[0], 208) == NULL)  // a multiple of ALIGNMENT
+        return -1;
+    heap_blocks = (BlockHeader *)(heap_base + ALIGNMENT) - 1;
+    return 0;
+}
+
+/**
+ * Find a free block for `size` bytes in constant time (TLSF policy).
+ *
+ * The request is rounded up to the next list boundary so that the head of any
+ * non-empty list found from the bitmaps is large enough, with no list walk.
+ *
+ * @param arena arena of the block
+ * @param size minimum size of the free block
+ * @return pointer to the header of a free block or `NULL`
+ */
+static BlockHeader *tlsf_find(Arena *arena, size_t size) {
+    int fl = 63 - __builtin_clzll(size);
+    size += ((size_t)1 << (fl - TLSF_SL_LOG2)) - 1;  // round up to the next list
+    if (size > UINT32_MAX)
+        return NULL;                                 // beyond the largest list
+    int idx = tlsf_index(size);
+    fl = idx / TLSF_SL_COUNT;
+    int sl = idx % TLSF_SL_COUNT;
+
+    // non-empty lists at the same first level, at or above sl
+    uint32_t sl_map = arena->tlsf_sl_bitmap[fl] & (~0u << sl);
+    if (sl_map == 0) {
+        // otherwise the smallest list of the next non-empty first level
+        uint32_t fl_map = arena->tlsf_fl_bitmap & (~0u << (fl + 1));
+        if (fl_map == 0)
+            return NULL;
+        fl = __builtin_ctz(fl_map);
+        sl_map = arena->tlsf_sl_bitmap[fl];
+    }
+    return arena->free_heads[fl * TLSF_SL_COUNT + __builtin_ctz(sl_map)];
+}
+
+/**
+ * Find a free block with size greater or equal to `size`.
+ *
+ * Only the list for the size class of `size` can hold blocks that are too
+ * small, so that list is searched; any block on a larger class fits, and the
+ * first non-empty larger class is found from the bitmap with a single ctz.
+ * Large requests, or small ones with no larger class available, take the best
+ * fit from the tree.
+ *
+ * @param arena arena of the block
+ * @param size minimum size of the free block
+ * @return pointer to the header of a free block or `NULL` if free blocks are
+ *         all smaller than `size`.
+ */
+static BlockHeader *find_fit(Arena *arena, size_t size) {
+    if (fit_policy == MM_POLICY_TLSF)
+        return tlsf_find(arena, size);
+    if (size >= TREE_MIN)
+        return tree_best_fit(arena, size);
+
+    int cls = size_class(size);
+
+    // search the class of the request
+    BlockHeader *hptr = arena->free_heads[cls];
+    while (hptr) {
+        size_t bSize = get_size(hptr); //get the size for comparison
+        if (bSize >= size) { //check is big enough
+            BlockHeader *next = get_next_free(hptr);
+            if (next != NULL) { //peek at the following block
+                size_t nSize = get_size(next);
+                if (nSize < bSize && nSize >= size) { //large enough but smaller
+                    return next; //it is a better fit
+                }
+            }
+            return hptr;
+        }
+        hptr = get_next_free(hptr); //traverse
+    }
+
+    // any block from a larger class is big enough
+    uint64_t larger = arena->free_bitmap & (~(uint64_t)0 << (cls + 1));
+    if (larger != 0)
+        return arena->free_heads[__builtin_ctzll(larger)];
+    return tree_best_fit(arena, size); //NULL when nothing fits
+}
+
+/**
+ * Allocate a block of `size` bytes inside the given free block `bp`. The
+ * block is cut from the back of a larger free block, so the free rest keeps
+ * the header at `bp`.
+ *
+ * @param arena arena of the block
+ * @param bp pointer to the header of a free block of at least `size` bytes
+ * @param size bytes to assign as an allocated block (multiple of ALIGNMENT)
+ * @return pointer to the header of the allocated block
+ */
+static BlockHeader *place(Arena *arena, BlockHeader *bp, size_t size) {
+    size_t newSize = get_size(bp)-size; //new remaining size to put in free list
+    free_list_remove(arena, bp); //remove bp from freelist
+    if(newSize<MIN_BLOCK_SIZE){
+        //if size is too small for freelist
+        set_header(bp,get_size(bp),1); //use all of the size to allocate
+        set_prev_allocated(get_next(bp),1); //the next block has no footer before it anymore
+        return bp;
+    }
+    set_header(bp,newSize,0); //set new size and 0
+    set_footer(bp,newSize,0); //set new size and 0
+    BlockHeader *allocated = get_next(bp);
+    set_header(allocated,size,1); //getnext of bp and set allocated to size
+    set_prev_allocated(allocated,0); //it follows the free part
+    set_prev_allocated(get_next(allocated),1);
+    free_coalesce(arena, bp); //check to coalsce
+    return allocated;
+}
+
+/**
+ * Compute the required block size (including space for the header) from the
+ * requested payload size. Allocated blocks have no footer, but the block must
+ * be able to hold a free block once it is released.
+ *
+ * @param payload_size requested payload size (at most MAX_BLOCK_SIZE - 4)
+ * @return a block size including the header that is a multiple of ALIGNMENT
+ */
+static size_t required_block_size(size_t payload_size) {
+    payload_size += 4;                    // add 4 for the header
+    size_t size = (payload_size + ALIGNMENT - 1) / ALIGNMENT * ALIGNMENT;
+    return MAX(size, (size_t)MIN_BLOCK_SIZE);
+}
+
+/**
+ * Tell whether a request is served by a slab run: only when its slot is
+ * smaller than the heap block it would take, since a block adds a header and
+ * never goes below MIN_BLOCK_SIZE (in 64-bit builds, requests of 1 to 12
+ * bytes fill a 16-byte block just like a 16-byte slot).
+ *
+ * @param size requested payload size
+ * @return whether the request goes to a slot
+ */
+static int slab_serves(size_t size) {
+    return size < SLAB_LIMIT &&
+           (size + ALIGNMENT - 1) / ALIGNMENT * ALIGNMENT < required_block_size(size);
+}
+
+/**
+ * Find the run holding a payload pointer, if any.
+ *
+ * @param ptr payload pointer returned by mm_malloc or mm_realloc
+ * @return address of the run header, or `NULL` for regular blocks
+ */
+static SlabRun *slab_run_of(void *ptr) {
+    char *lo = mem_heap_lo();
+    int page = ((char *)ptr - lo) / RUN_SIZE;
+    if (!(page_map[page] & PAGE_SLAB))
+        return NULL;
+    return (SlabRun *)(lo + (long)page * RUN_SIZE);
+}
+
+/**
+ * Find the arena owning a block or run.
+ *
+ * @param ptr any address inside the block, past its header
+ * @return the arena the block was carved from
+ */
+static Arena *arena_of(void *ptr) {
+    int page = ((char *)ptr - heap_base) / RUN_SIZE;
+    return &arenas[page_map[page] & ~PAGE_SLAB];
+}
+
+/**
+ * Add a run to the list of runs with free slots.
+ *
+ * @param arena arena of the block
+ * @param run address of the run header
+ * @param cls slot size class of the run
+ */
+static void slab_list_add(Arena *arena, SlabRun *run, int cls) {
+    run->prev = NULL;
+    run->next = arena->slab_partial[cls];
+    if (arena->slab_partial[cls] != NULL)
+        arena->slab_partial[cls]->prev = run;
+    arena->slab_partial[cls] = run;
+}
+
+/**
+ * Remove a run from the list of runs with free slots.
+ *
+ * @param arena arena of the block
+ * @param run address of the run header
+ * @param cls slot size class of the run
+ */
+static void slab_list_remove(Arena *arena, SlabRun *run, int cls) {
+    if (run->prev != NULL)
+        run->prev->next = run->next;
+    else
+        arena->slab_partial[cls] = run->next;
+    if (run->next != NULL)
+        run->next->prev = run->prev;
+}
+
+/**
+ * Carve a new run out of a free block, splitting off the free space before
+ * and after the RUN_SIZE-aligned run.
+ *
+ * @param arena arena of the block
+ * @param slot_size size of the slots of the run (multiple of ALIGNMENT)
+ * @return address of the run header, or `NULL` if the heap is full
+ */
+static SlabRun *slab_new_run(Arena *arena, int slot_size) {
+    // a block this large always contains an aligned run with free blocks
+    // (or nothing) on both sides
+    int need = 2 * RUN_SIZE + 2 * MIN_BLOCK_SIZE;
+    lock(&arena->lock);
+    BlockHeader *bp = find_fit(arena, need);
+    if (bp == NULL) {
+        bp = extend_heap(arena, need);
+        if (bp == NULL) {
+            unlock(&arena->lock);
+            return NULL;
+        }
+    }
+    free_list_remove(arena, bp);
+
+    char *lo = mem_heap_lo();
+    size_t size = get_size(bp);
+    int offset = (get_payload_addr(bp) - lo) % RUN_SIZE;
+    int pad = offset ? RUN_SIZE - offset : 0;  // free space before the run
+    if (pad > 0 && pad < MIN_BLOCK_SIZE)
+        pad += RUN_SIZE;                       // too small for a free block
+    size_t rest = size - pad - RUN_SIZE;       // free space after the run
+
+    BlockHeader *run_bp = (BlockHeader *)((char *)bp + pad);
+    BlockHeader *after = (BlockHeader *)((char *)run_bp + RUN_SIZE);
+    set_header(run_bp, RUN_SIZE, 1);
+    if (rest > 0)
+        set_header(after, rest, 0);
+    set_prev_allocated(after, 1);
+    if (pad > 0) {
+        set_prev_allocated(run_bp, 0);
+        set_header(bp, pad, 0);
+        free_coalesce(arena, bp);
+    }
+    if (rest > 0)
+        free_coalesce(arena, after);
+    unlock(&arena->lock);
+
+    SlabRun *run = (SlabRun *)get_payload_addr(run_bp);
+    page_map[((char *)run - lo) / RUN_SIZE] |= PAGE_SLAB;
+
+    // the last 4 bytes of the page hold the header of the next block
+    run->slot_size = slot_size;
+    run->slot_count = (RUN_SIZE - 4 - RUN_SLOTS_OFFSET) / slot_size;
+    run->free_count = run->slot_count;
+    for (int i = 0; i < RUN_MAP_WORDS; i++) {
+        int first = i * 32;  // first slot tracked by this word
+        if (run->slot_count >= first + 32)
+            run->free_map[i] = ~0u;
+        else if (run->slot_count > first)
+            run->free_map[i] = (1u << (run->slot_count - first)) - 1;
+        else
+            run->free_map[i] = 0;
+    }
+    return run;
+}
+
+/**
+ * Allocate a slot of a run.
+ *
+ * @param arena arena of the block
+ * @param size requested payload size (one that slab_serves accepts)
+ * @return address of the slot, or `NULL` if the heap is full
+ */
+static void *slab_alloc(Arena *arena, size_t size) {
+    int cls = (size - 1) / ALIGNMENT;  // 1..ALIGNMENT -> 0, ...
+    lock(&arena->slab_locks[cls]);
+    SlabRun *run = arena->slab_partial[cls];
+    if (run == NULL) {
+        run = slab_new_run(arena, (cls + 1) * ALIGNMENT);
+        if (run == NULL) {
+            unlock(&arena->slab_locks[cls]);
+            return NULL;
+        }
+        slab_list_add(arena, run, cls);
+    }
+
+    // pop the first free slot
+    int i = 0;
+    while (run->free_map[i] == 0)
+        i++;
+    int bit = __builtin_ctz(run->free_map[i]);
+    run->free_map[i] &= ~(1u << bit);
+    if (--run->free_count == 0)
+        slab_list_remove(arena, run, cls);  // full runs are not on any list
+    unlock(&arena->slab_locks[cls]);
+    count_allocation(size, run->slot_size);
+    return (char *)run + RUN_SLOTS_OFFSET + (i * 32 + bit) * run->slot_size;
+}
+
+/**
+ * Release a slot of a run. Empty runs go back to the heap, except the last
+ * one of their class.
+ *
+ * @param run address of the run header
+ * @param ptr address of the slot
+ */
+static void slab_free(SlabRun *run, void *ptr) {
+    Arena *arena = arena_of(run);
+    int cls = run->slot_size / ALIGNMENT - 1;
+    int slot = ((char *)ptr - (char *)run - RUN_SLOTS_OFFSET) / run->slot_size;
+    lock(&arena->slab_locks[cls]);
+    run->free_map[slot / 32] |= 1u << (slot % 32);
+    if (run->free_count++ == 0)
+        slab_list_add(arena, run, cls);  // it was full
+
+    if (run->free_count == run->slot_count &&
+            (run->prev != NULL || run->next != NULL)) {
+        slab_list_remove(arena, run, cls);
+        page_map[((char *)run - (char *)mem_heap_lo()) / RUN_SIZE] &= ~PAGE_SLAB;
+        lock(&arena->lock);
+        free_block(arena, (BlockHeader *)run - 1);
+        unlock(&arena->lock);
+    }
+    unlock(&arena->slab_locks[cls]);
+}
+
+/**
+ * Find the cache bin serving a request.
+ *
+ * @param size requested payload size
+ * @return the bin index, or -1 if requests of this size are not cached
+ */
+static int tcache_bin(size_t size) {
+    if (slab_serves(size))
+        return (size - 1) / ALIGNMENT;
+    if (size > TCACHE_LIMIT)
+        return -1;
+    size_t block_size = required_block_size(size);
+    if (block_size > TCACHE_LIMIT)
+        return -1;
+    return SLAB_CLASSES + (block_size - MIN_BLOCK_SIZE) / ALIGNMENT;
+}
+
+/**
+ * Start the counts of this thread over for a new heap, linking them on the
+ * list that mm_stats sums.
+ */
+static void alloc_stats_reset(void) {
+    lock(&stats_lock);
+    if (!alloc_stats.linked) {
+        alloc_stats.prev = NULL;
+        alloc_stats.next = alloc_stats_list;
+        if (alloc_stats_list != NULL)
+            alloc_stats_list->prev = &alloc_stats;
+        alloc_stats_list = &alloc_stats;
+        alloc_stats.linked = 1;
+    }
+    __atomic_store_n(&alloc_stats.requested_total, 0, __ATOMIC_RELAXED);
+    __atomic_store_n(&alloc_stats.placed_total, 0, __ATOMIC_RELAXED);
+    unlock(&stats_lock);
+}
+
+#ifdef MM_THREAD_SAFE
+/**
+ * Keep the counts of an exiting thread in retired_stats.
+ */
+static void alloc_stats_exit(void) {
+    lock(&stats_lock);
+    if (alloc_stats.linked) {
+        retired_stats.requested_total += alloc_stats.requested_total;
+        retired_stats.placed_total += alloc_stats.placed_total;
+        if (alloc_stats.prev != NULL)
+            alloc_stats.prev->next = alloc_stats.next;
+        else
+            alloc_stats_list = alloc_stats.next;
+        if (alloc_stats.next != NULL)
+            alloc_stats.next->prev = alloc_stats.prev;
+        alloc_stats.linked = 0;
+    }
+    unlock(&stats_lock);
+}
+
+static pthread_key_t tcache_key;
+static pthread_once_t tcache_key_once = PTHREAD_ONCE_INIT;
+
+static void tcache_exit(void *arg);
+
+static void tcache_key_create(void) {
+    pthread_key_create(&tcache_key, tcache_exit);
+}
+#endif
+
+/**
+ * Empty the cache of this thread if it was filled from a previous heap, and
+ * arrange for it to be flushed when the thread exits.
+ */
+static void tcache_check_epoch(void) {
+    if (tcache.epoch == heap_epoch)
+        return;
+    memset(&tcache, 0, sizeof(tcache));
+    tcache.epoch = heap_epoch;
+    alloc_stats_reset();
+#ifdef MM_THREAD_SAFE
+    pthread_once(&tcache_key_once, tcache_key_create);
+    pthread_setspecific(tcache_key, &tcache);  // a non-NULL value runs tcache_exit
+#endif
+}
+
+/**
+ * Count a block handed out by malloc, calloc or realloc, for mm_stats.
+ *
+ * @param requested requested payload size
+ * @param placed size of the block, slot or mapping that serves it
+ */
+static void count_allocation(size_t requested, size_t placed) {
+    tcache_check_epoch();  // counts of a previous heap are dropped
+    __atomic_store_n(&alloc_stats.requested_total, alloc_stats.requested_total + requested,
+                     __ATOMIC_RELAXED);
+    __atomic_store_n(&alloc_stats.placed_total, alloc_stats.placed_total + placed,
+                     __ATOMIC_RELAXED);
+}
+
+/**
+ * Find the arena of this thread, assigning one round-robin on first use.
+ *
+ * @return the arena new blocks of this thread are carved from
+ */
+static Arena *thread_arena(void) {
+    tcache_check_epoch();
+    if (tcache.arena == NULL) {
+        unsigned next = __atomic_fetch_add(&next_arena, 1, __ATOMIC_RELAXED);
+        tcache.arena = &arenas[next % num_arenas];
+        __atomic_fetch_add(&tcache.arena->threads, 1, __ATOMIC_SEQ_CST);
+    }
+    return tcache.arena;
+}
+
+/**
+ * Hand a block to its arena from a thread of another arena, without taking
+ * any lock: push it on the remote free stack of the arena.
+ *
+ * @param arena arena of the block
+ * @param ptr payload of the block, still marked allocated
+ */
+static void remote_free_push(Arena *arena, void *ptr) {
+    void *head = __atomic_load_n(&arena->remote_frees, __ATOMIC_RELAXED);
+    do {
+        *(void **)ptr = head;
+    } while (!__atomic_compare_exchange_n(&arena->remote_frees, &head, ptr, 1,
+                                          __ATOMIC_SEQ_CST, __ATOMIC_RELAXED));
+}
+
+/**
+ * Take the whole remote free stack of an arena.
+ *
+ * @param arena arena to drain
+ * @return the first block of the stack, or `NULL` if it is empty
+ */
+static void *remote_free_take(Arena *arena) {
+    // sequentially consistent with the push and with threads, see remote_free_orphans
+    if (__atomic_load_n(&arena->remote_frees, __ATOMIC_SEQ_CST) == NULL)
+        return NULL;
+    return __atomic_exchange_n(&arena->remote_frees, NULL, __ATOMIC_SEQ_CST);
+}
+
+/**
+ * Free the heap blocks of a taken remote free stack, with the arena lock
+ * held. Slab slots cannot be released under the arena lock, as slab locks
+ * are taken before it: they are handed back for remote_free_slots.
+ *
+ * @param arena arena of the blocks, locked
+ * @param ptr first block of the stack
+ * @return the slab slots of the stack, linked through their first word
+ */
+static void *remote_free_blocks(Arena *arena, void *ptr) {
+    void *slots = NULL;
+    while (ptr != NULL) {
+        void *next = *(void **)ptr;
+        if (slab_run_of(ptr) != NULL) {
+            *(void **)ptr = slots;
+            slots = ptr;
+        } else {
+            free_block(arena, (BlockHeader *)ptr - 1);
+        }
+        ptr = next;
+    }
+    return slots;
+}
+
+/**
+ * Release slab slots left by remote_free_blocks, without the arena lock.
+ *
+ * @param ptr first slot, linked through their first word
+ */
+static void remote_free_slots(void *ptr) {
+    while (ptr != NULL) {
+        void *next = *(void **)ptr;
+        slab_free(slab_run_of(ptr), ptr);
+        ptr = next;
+    }
+}
+
+/**
+ * Free the blocks other threads pushed on the remote free stack of an arena.
+ * The whole stack is taken at once, so any thread may drain it.
+ *
+ * @param arena arena to drain
+ */
+static void remote_free_drain(Arena *arena) {
+    void *ptr = remote_free_take(arena);
+    if (ptr == NULL)
+        return;
+    lock(&arena->lock);
+    void *slots = remote_free_blocks(arena, ptr);
+    unlock(&arena->lock);
+    remote_free_slots(slots);
+}
+
+/**
+ * Drain the arenas no thread is bound to anymore, after pushing blocks to
+ * other arenas. A thread leaving an arena drains it after dropping its
+ * count, and a pusher reads the count after pushing: with both sequentially
+ * consistent, at least one of them sees the block.
+ */
+static void remote_free_orphans(void) {
+    for (int a = 0; a < num_arenas; a++) {
+        if (__atomic_load_n(&arenas[a].threads, __ATOMIC_SEQ_CST) == 0)
+            remote_free_drain(&arenas[a]);
+    }
+}
+
+/**
+ * Release the blocks of a bin after the first `keep` ones. Blocks of the
+ * arena of this thread are freed under a single lock, the others are pushed
+ * to their own arena.
+ *
+ * @param bin cache bin
+ * @param keep number of blocks left in the bin
+ */
+static void tcache_flush(int bin, int keep) {
+    void **link = &tcache.heads[bin];
+    for (int i = 0; i < keep && *link != NULL; i++)
+        link = (void **)*link;
+    void *ptr = *link;
+    *link = NULL;
+    tcache.counts[bin] = MIN(keep, tcache.counts[bin]);
+
+    Arena *own = thread_arena();
+    int locked = 0, pushed = 0;
+    while (ptr != NULL) {
+        void *next = *(void **)ptr;
+        Arena *arena = arena_of(ptr);
+        if (arena != own) {
+            remote_free_push(arena, ptr);
+            pushed = 1;
+        } else if (bin < SLAB_CLASSES) {
+            slab_free(slab_run_of(ptr), ptr);
+        } else {
+            if (!locked)
+                lock(&own->lock);
+            locked = 1;
+            free_block(own, (BlockHeader *)ptr - 1);
+        }
+        ptr = next;
+    }
+    if (locked)
+        unlock(&own->lock);
+    if (pushed)
+        remote_free_orphans();
+}
+
+#ifdef MM_THREAD_SAFE
+/**
+ * Give the cache of an exiting thread back to the heap.
+ *
+ * @param arg unused, the value registered with the key
+ */
+static void tcache_exit(void *arg) {
+    (void)arg;
+    alloc_stats_exit();
+    if (tcache.epoch != heap_epoch)
+        return;  // blocks of a previous heap
+    for (int bin = 0; bin < TCACHE_BINS; bin++)
+        tcache_flush(bin, 0);
+    // leave the arena, then free what was pushed to it: if this was its last
+    // thread, no allocation of the arena will do it
+    Arena *own = thread_arena();
+    __atomic_fetch_sub(&own->threads, 1, __ATOMIC_SEQ_CST);
+    remote_free_drain(own);
+}
+#endif
+
+/**
+ * Take a cached block for a request.
+ *
+ * @param size requested payload size
+ * @return the payload of a cached block, or `NULL`
+ */
+static void *tcache_get(size_t size) {
+    int bin = tcache_bin(size);
+    if (bin < 0 || tcache_high == 0)
         return NULL;
+    tcache_check_epoch();
+    void *ptr = tcache.heads[bin];
+    if (ptr != NULL) {
+        tcache.heads[bin] = *(void **)ptr;
+        tcache.counts[bin]--;
+        count_allocation(size, bin < SLAB_CLASSES ? (size_t)(bin + 1) * ALIGNMENT :
+                         MIN_BLOCK_SIZE + (size_t)(bin - SLAB_CLASSES) * ALIGNMENT);
+    }
+    return ptr;
+}
+
+/**
+ * Cache a block being freed, flushing half of its bin past the high-water
+ * mark.
+ *
+ * @param ptr payload of the block
+ * @param run the slab run of the block, or `NULL` for a heap block
+ * @return 1 if the block was cached, 0 if it must be freed
+ */
+static int tcache_put(void *ptr, SlabRun *run) {
+    if (tcache_high == 0)
+        return 0;
+    int bin;
+    if (run != NULL) {
+        bin = run->slot_size / ALIGNMENT - 1;
     } else {
-         if (size_block<rSize){ //when the size is smaller than the required size
-            if(!get_allocated(get_next(hptr))){     
-                if(aSize>=rSize){ //if the added size is greater than the required size
-                    free_list_remove(get_next(hptr)); //get it out from the list
-                    if(newSize<=250){ //set condition for size
-                        set_header(hptr,aSize,1); //set allocated
-                        set_footer(hptr,aSize,1); //set allocated 
-                    }else{ 
-                        set_header(hptr,rSize,1); //set allocated
-                        set_footer(hptr,rSize,1); //set allocated
-                        set_header(get_next(hptr),newSize,0); //getnext of hptr is the remaining block so set header
-                        set_footer(get_next(hptr),newSize,0); //set footer of getnext of hptr
-                        free_coalesce(get_next(hptr)); //check to coalsce
-                    }
-                    return get_payload_addr(hptr);
-                }
-            }
-            void*new_ptr = mm_malloc(size);
-            memcpy(new_ptr,ptr,MIN(size,(unsigned)get_size(ptr-4)-8));
+        // read without the heap lock: the size of an allocated block is
+        // stable, only its prev-allocated bit changes under us
+        size_t size = __atomic_load_n((BlockHeader *)ptr - 1, __ATOMIC_RELAXED) & ~7;
+        if (size > TCACHE_LIMIT)
+            return 0;
+        bin = SLAB_CLASSES + (size - MIN_BLOCK_SIZE) / ALIGNMENT;
+    }
+    tcache_check_epoch();
+    *(void **)ptr = tcache.heads[bin];
+    tcache.heads[bin] = ptr;
+    if (++tcache.counts[bin] > tcache_high)
+        tcache_flush(bin, tcache_high / 2);
+    return 1;
+}
+
+/**
+ * Tell whether a payload was allocated in its own mapping.
+ *
+ * @param ptr payload pointer returned by mm_malloc or mm_realloc
+ * @return 1 for a mapped block, 0 for a heap block or slot
+ */
+static int is_mapped(void *ptr) {
+    return (uintptr_t)((char *)ptr - heap_base) >= MAX_HEAP;
+}
+
+/**
+ * Size of the mapping for a payload of `size` bytes, in whole pages.
+ *
+ * @param size payload size
+ * @return mapping size, or 0 if it overflows
+ */
+static size_t mapped_size(size_t size) {
+    if (size > SIZE_MAX - ALIGNMENT - page_size)
+        return 0;
+    return (size + ALIGNMENT + page_size - 1) / page_size * page_size;
+}
+
+/**
+ * Allocate a payload in a new mapping. Its memory is zero.
+ *
+ * @param size payload size
+ * @return the payload, or `NULL` if the mapping failed
+ */
+static void *mapped_alloc(size_t size) {
+    size_t map_size = mapped_size(size);
+    char *map = map_size != 0 ? mem_map(map_size) : NULL;
+    if (map == NULL)
+        return NULL;
+    *(size_t *)map = map_size;
+    __atomic_fetch_add(&mapped_bytes, map_size, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&mapped_count, 1, __ATOMIC_RELAXED);
+    count_allocation(size, map_size);
+    return map + ALIGNMENT;
+}
+
+/**
+ * Give the mapping of a payload back to the OS.
+ *
+ * @param ptr payload of a mapped block
+ */
+static void mapped_free(void *ptr) {
+    char *map = (char *)ptr - ALIGNMENT;
+    __atomic_fetch_sub(&mapped_bytes, *(size_t *)map, __ATOMIC_RELAXED);
+    __atomic_fetch_sub(&mapped_count, 1, __ATOMIC_RELAXED);
+    mem_unmap(map, *(size_t *)map);
+}
+
+/**
+ * Resize the mapping of a payload, moving it without copying if needed.
+ *
+ * @param ptr payload of a mapped block
+ * @param size new payload size
+ * @return the new payload, or `NULL` (the old one is kept) on failure
+ */
+static void *mapped_realloc(void *ptr, size_t size) {
+    char *map = (char *)ptr - ALIGNMENT;
+    size_t map_size = mapped_size(size);
+    if (map_size == 0)
+        return NULL;
+    if (map_size != *(size_t *)map) {
+        size_t old_size = *(size_t *)map;
+        map = mem_remap(map, old_size, map_size);
+        if (map == NULL)
+            return NULL;
+        *(size_t *)map = map_size;
+        __atomic_fetch_add(&mapped_bytes, map_size - old_size, __ATOMIC_RELAXED);
+    }
+    count_allocation(size, map_size);
+    return map + ALIGNMENT;
+}
+
+/**
+ * Allocate a block from the heap of an arena: find a free block, or extend
+ * the heap with one that is large enough (the new block is at least the
+ * required size, coalescing only makes it larger).
+ *
+ * @param arena arena of the thread
+ * @param payload_size requested payload size
+ * @param zero_start if not `NULL`, receives the first byte of the payload
+ *        known to be zero, because it was purged
+ * @param zero_end if not `NULL`, receives the end of that range
+ * @return the payload address, or `NULL` if the heap is full
+ */
+static void *heap_alloc(Arena *arena, size_t payload_size, char **zero_start, char **zero_end) {
+    size_t size = required_block_size(payload_size);
+    lock(&arena->lock);
+    // blocks other threads freed to the arena may fit the request
+    void *ptr = remote_free_take(arena);
+    void *slots = ptr == NULL ? NULL : remote_free_blocks(arena, ptr);
+    BlockHeader *bp = find_fit(arena, size);
+    if (bp == NULL)
+        bp = extend_heap(arena, size);
+    if (bp != NULL) {
+        if (zero_start != NULL) {
+            *zero_start = *zero_end = NULL;
+            if (get_purged(bp))
+                purge_range(bp, zero_start, zero_end);  // place writes no payload
+        }
+        bp = place(arena, bp, size);
+        count_allocation(payload_size, get_size(bp));
+    }
+    heap_decay(arena);  // an arena that stopped freeing still decays
+    unlock(&arena->lock);
+    remote_free_slots(slots);
+    return bp == NULL ? NULL : get_payload_addr(bp);
+}
+
+void mm_free(void *bp) {
+    if (bp == NULL)
+        return;
+    if (is_mapped(bp)) {
+        mapped_free(bp);
+        return;
+    }
+    SlabRun *run = slab_run_of(bp);
+    if (tcache_put(bp, run))
+        return;
+    Arena *arena = arena_of(bp); //blocks go back to their own arena
+    if (arena != thread_arena()) {
+        remote_free_push(arena, bp); //no lock traffic on the free path
+        if (__atomic_load_n(&arena->threads, __ATOMIC_SEQ_CST) == 0)
+            remote_free_drain(arena);  // its threads have exited
+        return;
+    }
+    if (run != NULL) {
+        slab_free(run, bp);
+        return;
+    }
+    BlockHeader* blockH; //new pointer
+    blockH = (BlockHeader*)bp-1; //move back 4bytes
+    lock(&arena->lock);
+    free_block(arena, blockH);
+    unlock(&arena->lock);
+}
+
+void *mm_malloc(size_t size) {
+    // ignore spurious requests
+    if (size == 0)
+        return NULL;
+    void *cached = tcache_get(size);
+    if (cached != NULL)
+        return cached;
+    Arena *arena = thread_arena();
+    if (slab_serves(size)) {
+        remote_free_drain(arena);
+        return slab_alloc(arena, size);
+    }
+    if (size >= mmap_threshold || size > MAX_BLOCK_SIZE - 4)
+        return mapped_alloc(size);
+    return heap_alloc(arena, size, NULL, NULL);  // drains the arena under its lock
+}
+
+void *mm_calloc(size_t count, size_t size) {
+    if (size != 0 && count > SIZE_MAX / size)
+        return NULL;  // count * size overflows
+    size *= count;
+    if (size >= mmap_threshold || size > MAX_BLOCK_SIZE - 4)
+        return mapped_alloc(size);  // new mappings are zero
+    if (size <= TCACHE_LIMIT) {
+        // small requests: clearing is cheap
+        char *ptr = mm_malloc(size);
+        if (ptr != NULL)
+            memset(ptr, 0, size);
+        return ptr;
+    }
+
+    Arena *arena = thread_arena();
+    char *zero_start, *zero_end;
+    char *ptr = heap_alloc(arena, size, &zero_start, &zero_end);
+    if (ptr == NULL)
+        return NULL;
+    // clear the payload, except the pages known to be zero
+    char *end = ptr + size;
+    zero_start = MAX(MIN(zero_start, end), ptr);
+    zero_end = MAX(MIN(zero_end, end), zero_start);
+    memset(ptr, 0, zero_start - ptr);
+    memset(zero_end, 0, end - zero_end);
+    return ptr;
+}
+
+/* A block resized in place keeps up to this many spare bytes instead of
+ * splitting them off, so that it can grow back by as much without moving */
+#define REALLOC_SLACK 256
+
+void *mm_realloc(void *ptr, size_t size) {
+    if (ptr == NULL) {
+        // equivalent to malloc
+        return mm_malloc(size);
+    } else if (size == 0) {
+        // equivalent to free
+        mm_free(ptr);
+        return NULL;
+    }
+
+    if (is_mapped(ptr)) {
+        if (size >= mmap_threshold)
+            return mapped_realloc(ptr, size);
+        void *new_ptr = mm_malloc(size);  // small enough for the heap again
+        if (new_ptr != NULL) {
+            memcpy(new_ptr, ptr, size);
+            mapped_free(ptr);
+        }
+        return new_ptr;
+    }
+
+    SlabRun *run = slab_run_of(ptr);
+    if (run != NULL) {
+        if (size <= (size_t)run->slot_size) {
+            count_allocation(size, run->slot_size);
+            return ptr; // still fits in its slot
+        }
+        void *new_ptr = mm_malloc(size);
+        if (new_ptr != NULL) {
+            memcpy(new_ptr, ptr, run->slot_size);
+            slab_free(run, ptr);
+        }
+        return new_ptr;
+    }
+
+    if (size > MAX_BLOCK_SIZE - 4) {
+        // does not fit in a block header: move to a mapping
+        void *new_ptr = mm_malloc(size);
+        if (new_ptr != NULL) {
+            memcpy(new_ptr, ptr, get_size((BlockHeader *)ptr - 1) - 4);
             mm_free(ptr);
-            return new_ptr;
         }
-        else if(size_block>=rSize){
-            if (sSize>250){
-                set_header(hptr,rSize,1); //set allocated
-                set_footer(hptr,rSize,1); //set allocated
-                set_header(get_next(hptr),sSize,0); //getnext of ptr is the remaining block so set header
-                set_footer(get_next(hptr),sSize,0); //set footer of getnext of hptr
-                free_coalesce(get_next(hptr)); //check to coalsce
+        return new_ptr;
+    }
+
+    BlockHeader* hptr = (BlockHeader*)ptr-1; //set header
+    Arena *arena = arena_of(ptr);
+    lock(&arena->lock); //neighbors can change under us otherwise
+    size_t rSize = required_block_size(size); // get the required block size
+    size_t size_block=get_size(hptr); //get size using the header 
+    size_t sSize = size_block - rSize; // size of the subtracted
+    size_t aSize = get_size(hptr) + get_size(get_next(hptr)); //add the neighboring size
+    size_t newSize = aSize - rSize;
+    if (size_block<rSize){ //when the size is smaller than the required size
+        if(!get_allocated(get_next(hptr))){     
+            if(aSize>=rSize){ //if the added size is greater than the required size
+                free_list_remove(arena, get_next(hptr)); //get it out from the list
+                if(newSize<REALLOC_SLACK){ //keep the spare bytes
+                    set_header(hptr,aSize,1); //set allocated
+                    set_prev_allocated(get_next(hptr),1); //the next block has no footer before it anymore
+                }else{ 
+                    set_header(hptr,rSize,1); //set allocated
+                    set_header(get_next(hptr),newSize,0); //getnext of hptr is the remaining block so set header
+                    set_prev_allocated(get_next(hptr),1); //it follows the allocated part
+                    free_block(arena, get_next(hptr)); //check to coalsce
+                }
+                count_allocation(size, get_size(hptr));
+                unlock(&arena->lock);
+                return get_payload_addr(hptr);
             }
-            return get_payload_addr(hptr);
         }
-       /*case find largest free block <=size ->resize
-         
-        case size is larger check adjacent -> coalesce
-
-        case allocate new block */
+        unlock(&arena->lock); //mm_malloc and mm_free take the lock themselves
+        void*new_ptr = mm_malloc(size);
+        if (new_ptr == NULL)
+            return NULL; //the old block is left untouched
+        memcpy(new_ptr,ptr,MIN(size,size_block-4)); //payload is the block minus the header
+        mm_free(ptr);
+        return new_ptr;
+    }
+    else if(size_block>=rSize){
+        if (sSize>=REALLOC_SLACK){
+            set_header(hptr,rSize,1); //set allocated
+            set_header(get_next(hptr),sSize,0); //getnext of ptr is the remaining block so set header
+            set_prev_allocated(get_next(hptr),1); //it follows the allocated part
+            free_block(arena, get_next(hptr)); //check to coalsce
+        }
+        count_allocation(size, get_size(hptr));
+        unlock(&arena->lock);
+        return get_payload_addr(hptr);
     }
+    unlock(&arena->lock);
     return NULL;
 }
     
 
+
+/**
+ * Find the size of the largest free block of an arena, in constant time
+ * outside the tree: the rightmost node of the tree, or else the head of the
+ * highest non-empty list, whose blocks are within the size range of the list.
+ * The arena lock must be held.
+ *
+ * @param arena arena to search
+ * @return size of the largest free block (to within its list), or 0
+ */
+static size_t largest_free_block(Arena *arena) {
+    BlockHeader *node = arena->tree_root;
+    if (node != NULL) {
+        while (get_right(node) != NULL)
+            node = get_right(node);
+        return get_size(node);
+    }
+    int idx;
+    if (fit_policy == MM_POLICY_TLSF) {
+        if (arena->tlsf_fl_bitmap == 0)
+            return 0;
+        int fl = 31 - __builtin_clz(arena->tlsf_fl_bitmap);
+        idx = fl * TLSF_SL_COUNT + 31 - __builtin_clz(arena->tlsf_sl_bitmap[fl]);
+    } else {
+        if (arena->free_bitmap == 0)
+            return 0;
+        idx = 63 - __builtin_clzll(arena->free_bitmap);
+    }
+    return get_size(arena->free_heads[idx]);
+}
+
+/*
+ * The running totals of the arenas are summed; only the largest free block
+ * has to be looked for.
+ */
+int mm_stats(HeapStats *stats) {
+    memset(stats, 0, sizeof(*stats));
+    for (int a = 0; a < num_arenas; a++) {
+        Arena *arena = &arenas[a];
+        lock(&arena->lock);
+        stats->allocated_bytes += arena->heap_bytes - arena->free_bytes;
+        stats->free_bytes += arena->free_bytes;
+        stats->free_blocks += arena->free_blocks;
+        for (int i = 0; i < MM_STATS_BUCKETS; i++)
+            stats->free_histogram[i] += arena->free_histogram[i];
+        stats->largest_free = MAX(stats->largest_free, largest_free_block(arena));
+        unlock(&arena->lock);
+    }
+    lock(&stats_lock);
+    stats->requested_total = retired_stats.requested_total;
+    stats->placed_total = retired_stats.placed_total;
+    for (AllocStats *st = alloc_stats_list; st != NULL; st = st->next) {
+        stats->requested_total += __atomic_load_n(&st->requested_total, __ATOMIC_RELAXED);
+        stats->placed_total += __atomic_load_n(&st->placed_total, __ATOMIC_RELAXED);
+    }
+    unlock(&stats_lock);
+    stats->heap_size = mem_heapsize();
+    stats->mapped_bytes = __atomic_load_n(&mapped_bytes, __ATOMIC_RELAXED);
+    stats->mapped_count = __atomic_load_n(&mapped_count, __ATOMIC_RELAXED);
+    if (stats->placed_total > 0)
+        stats->placement_overhead = 1 - (double)stats->requested_total / stats->placed_total;
+    if (stats->free_bytes > 0)
+        stats->external_fragmentation = 1 - (double)stats->largest_free / stats->free_bytes;
+    return 0;
+}
+
+
+/**
+ * mm_check and mm_heap_walk are debugging aids, compiled out with -DNDEBUG.
+ * Both hold every arena lock, so the heap does not change under them; the
+ * walk visits the blocks of all chunks in address order, from heap_blocks.
+ */
+#ifndef NDEBUG
+/**
+ * Report the first inconsistency found by mm_check.
+ *
+ * @param msg what is wrong
+ * @param bp block where it was found
+ * @return -1
+ */
+static int check_fail(const char *msg, BlockHeader *bp) {
+    fprintf(stderr, "mm_check: %s at block %p\n", msg, (void *)bp);
+    return -1;
+}
+
+/**
+ * Check a subtree of free blocks: links, order, colors, and the blocks.
+ *
+ * @param arena arena owning the tree
+ * @param node root of the subtree, or `NULL`
+ * @param parent expected parent of the root
+ * @param count incremented for each node
+ * @return black height of the subtree, or -1 if it is inconsistent
+ */
+static int check_tree(Arena *arena, BlockHeader *node, BlockHeader *parent, size_t *count) {
+    if (node == NULL)
+        return 0;
+    (*count)++;
+    if (get_parent(node) != parent)
+        return check_fail("tree parent link broken", node);
+    if (get_allocated(node) || get_size(node) < TREE_MIN || arena_of(node + 1) != arena)
+        return check_fail("tree holds a block it should not", node);
+    if (is_red(node) && (is_red(get_left(node)) || is_red(get_right(node))))
+        return check_fail("red tree node with a red child", node);
+    if ((get_left(node) != NULL && !tree_less(get_left(node), node)) ||
+            (get_right(node) != NULL && !tree_less(node, get_right(node))))
+        return check_fail("tree out of order", node);
+    int left = check_tree(arena, get_left(node), node, count);
+    int right = check_tree(arena, get_right(node), node, count);
+    if (left < 0 || right < 0)
+        return -1;
+    if (left != right)
+        return check_fail("tree black heights differ", node);
+    return left + !is_red(node);
+}
+
+/**
+ * Check the free lists and tree of an arena: link symmetry, list classes,
+ * bitmaps, and that they hold only free blocks of the arena.
+ *
+ * @param arena arena to check
+ * @param max_blocks free blocks in the heap, to stop on cycles
+ * @param count receives the number of listed blocks
+ * @return 0, or -1 if the lists are inconsistent
+ */
+static int check_free_lists(Arena *arena, size_t max_blocks, size_t *count) {
+    *count = 0;
+    for (int idx = 0; idx < NUM_LISTS; idx++) {
+        BlockHeader *head = arena->free_heads[idx];
+        int marked = fit_policy == MM_POLICY_TLSF ?
+                arena->tlsf_sl_bitmap[idx / TLSF_SL_COUNT] >> (idx % TLSF_SL_COUNT) & 1 :
+                idx < NUM_CLASSES && (arena->free_bitmap >> idx & 1);
+        if (marked != (head != NULL))
+            return check_fail("free list bitmap disagrees with its list", head);
+        if (fit_policy == MM_POLICY_TLSF && head != NULL &&
+                !(arena->tlsf_fl_bitmap >> (idx / TLSF_SL_COUNT) & 1))
+            return check_fail("first level bitmap misses a list", head);
+        BlockHeader *prev = NULL;
+        for (BlockHeader *bp = head; bp != NULL; prev = bp, bp = get_next_free(bp)) {
+            if (++*count > max_blocks)
+                return check_fail("free list has a cycle", bp);
+            if (get_prev_free(bp) != prev)
+                return check_fail("free list links not symmetric", bp);
+            if (get_allocated(bp) || free_list_index(get_size(bp)) != idx ||
+                    arena_of(bp + 1) != arena)
+                return check_fail("free list holds a block it should not", bp);
+            if (fit_policy == MM_POLICY_SEGFIT && get_size(bp) >= TREE_MIN)
+                return check_fail("large block listed instead of in the tree", bp);
+        }
+        if (arena->free_tails[idx] != prev)
+            return check_fail("free list tail is not its last block", prev);
+    }
+    if (fit_policy == MM_POLICY_TLSF) {
+        for (int fl = 0; fl < TLSF_FL_COUNT; fl++)
+            if ((arena->tlsf_fl_bitmap >> fl & 1) != (arena->tlsf_sl_bitmap[fl] != 0))
+                return check_fail("first level bitmap disagrees with the second", NULL);
+    }
+    if (is_red(arena->tree_root))
+        return check_fail("tree root is red", arena->tree_root);
+    return check_tree(arena, arena->tree_root, NULL, count) < 0 ? -1 : 0;
+}
+
+/*
+ * Takes and releases every arena lock, in index order.
+ */
+static void lock_arenas(void) {
+    for (int a = 0; a < num_arenas; a++)
+        lock(&arenas[a].lock);
+}
+
+static void unlock_arenas(void) {
+    for (int a = num_arenas - 1; a >= 0; a--)
+        unlock(&arenas[a].lock);
+}
+
+/**
+ * Walk the blocks of every chunk, checking the boundary tags, and count the
+ * free blocks of each arena. The arena locks must be held.
+ *
+ * @param free_blocks receives the free blocks found for each arena
+ * @param free_bytes receives their bytes for each arena
+ * @param dirty_blocks receives the free blocks each arena can purge
+ * @return 0, or -1 if a block is inconsistent
+ */
+static int check_blocks(size_t *free_blocks, size_t *free_bytes, size_t *dirty_blocks) {
+    char *end = (char *)mem_heap_hi() + 1;
+    BlockHeader *chunk = heap_blocks;
+    while (1) {
+        if (get_size(chunk) != ALIGNMENT || !get_allocated(chunk) || !get_prev_allocated(chunk))
+            return check_fail("bad prologue", chunk);
+        Arena *arena = arena_of(chunk + 1);
+        BlockHeader *bp = get_next(chunk);
+        int prev_free = 0;
+        for (; get_size(bp) > 0; bp = get_next(bp)) {
+            size_t size = get_size(bp);
+            if (size % ALIGNMENT != 0 || size < MIN_BLOCK_SIZE || (char *)bp + size >= end)
+                return check_fail("bad block size", bp);
+            if ((uintptr_t)get_payload_addr(bp) % ALIGNMENT != 0)
+                return check_fail("payload not aligned", bp);
+            if (get_prev_allocated(bp) == prev_free)
+                return check_fail("prev-allocated bit wrong", bp);
+            if (arena_of(bp + 1) != arena)
+                return check_fail("block of another arena inside a chunk", bp);
+            if (get_allocated(bp)) {
+                prev_free = 0;
+                continue;
+            }
+            if (*(BlockHeader *)((char *)bp + size - sizeof(BlockHeader)) != size)
+                return check_fail("footer does not match header", bp);
+            if (prev_free && get_size(get_prev(bp)) + size <= MAX_BLOCK_SIZE)
+                return check_fail("adjacent free blocks not coalesced", bp);
+            prev_free = 1;
+            free_blocks[arena->index]++;
+            free_bytes[arena->index] += size;
+            dirty_blocks[arena->index] += size >= PURGE_MIN && !get_purged(bp);
+        }
+        if (!get_allocated(bp) || get_prev_allocated(bp) == prev_free)
+            return check_fail("bad epilogue", bp);
+        if ((char *)(bp + 1) >= end)
+            return 0;
+        chunk = (BlockHeader *)((char *)(bp + 1) + ALIGNMENT) - 1;  // skip padding
+    }
+}
+
+/**
+ * Check the dirty list of an arena: link symmetry, order by freed_at, and
+ * that it holds the dirty large free blocks of the arena.
+ *
+ * @param arena arena to check
+ * @param dirty_blocks dirty large free blocks of the arena in the heap
+ * @return 0, or -1 if the list is inconsistent
+ */
+static int check_dirty_list(Arena *arena, size_t dirty_blocks) {
+    size_t count = 0;
+    BlockHeader *prev = NULL;
+    for (BlockHeader *bp = arena->dirty_head; bp != NULL; prev = bp,
+            bp = from_offset(((LargeFreeBlockHeader *)bp)->dirty_next)) {
+        LargeFreeBlockHeader *lp = (LargeFreeBlockHeader *)bp;
+        if (++count > dirty_blocks)
+            return check_fail("dirty list has a cycle or a block it should not", bp);
+        if (from_offset(lp->dirty_prev) != prev)
+            return check_fail("dirty list links not symmetric", bp);
+        if (get_allocated(bp) || get_purged(bp) || get_size(bp) < PURGE_MIN ||
+                arena_of(bp + 1) != arena)
+            return check_fail("dirty list holds a block it should not", bp);
+        if (prev != NULL && lp->freed_at - ((LargeFreeBlockHeader *)prev)->freed_at > INT32_MAX)
+            return check_fail("dirty list out of order", bp);
+    }
+    if (arena->dirty_tail != prev)
+        return check_fail("dirty list tail is not its last block", prev);
+    if (count != dirty_blocks)
+        return check_fail("dirty blocks missing from the dirty list", NULL);
+    return 0;
+}
+
+int mm_check(void) {
+    size_t free_blocks[MAX_ARENAS] = { 0 }, free_bytes[MAX_ARENAS] = { 0 };
+    size_t dirty_blocks[MAX_ARENAS] = { 0 };
+    lock_arenas();
+    int result = check_blocks(free_blocks, free_bytes, dirty_blocks);
+    for (int a = 0; a < num_arenas && result == 0; a++) {
+        Arena *arena = &arenas[a];
+        size_t listed;
+        result = check_free_lists(arena, free_blocks[a], &listed);
+        // listed blocks are free blocks of the arena, each linked once, so
+        // equal counts mean every free block is listed exactly once
+        if (result == 0 && listed != free_blocks[a])
+            result = check_fail("free blocks missing from the free lists", NULL);
+        if (result == 0 && (arena->free_blocks != free_blocks[a] || arena->free_bytes != free_bytes[a]))
+            result = check_fail("free block totals out of date", NULL);
+        if (result == 0)
+            result = check_dirty_list(arena, dirty_blocks[a]);
+    }
+    unlock_arenas();
+    return result;
+}
+
+int mm_heap_walk(int (*visit)(void *payload, size_t size, int allocated, void *arg), void *arg) {
+    int result = 0;
+    lock_arenas();
+    char *end = (char *)mem_heap_hi() + 1;
+    BlockHeader *bp = heap_blocks;
+    while (result == 0) {
+        for (bp = get_next(bp); get_size(bp) > 0 && result == 0; bp = get_next(bp))
+            result = visit(get_payload_addr(bp), get_size(bp) - sizeof(BlockHeader),
+                           get_allocated(bp), arg);
+        if (result != 0 || (char *)(bp + 1) >= end)
+            break;
+        bp = (BlockHeader *)((char *)(bp + 1) + ALIGNMENT) - 1;  // next prologue
+    }
+    unlock_arenas();
+    return result;
+}
+#endif
+
+#ifdef MM_LATENCY
+static uint64_t latency_now(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000000000 + now.tv_nsec;
+}
+
+/**
+ * Histogram bucket of a latency
+ *
+ * @param ns latency in nanoseconds
+ * @return bucket index, the last one for anything larger
+ */
+static int latency_bucket(uint64_t ns) {
+    if (ns < LATENCY_SUB)
+        return (int)ns;
+    int e = 63 - __builtin_clzll(ns);  // ns is in [2^e, 2^(e+1))
+    int bucket = (e - LATENCY_SUB_BITS + 1) * LATENCY_SUB +
+                 (int)(ns >> (e - LATENCY_SUB_BITS) & (LATENCY_SUB - 1));
+    return MIN(bucket, MM_LATENCY_BUCKETS - 1);
+}
+
+/**
+ * Largest latency counted in a bucket
+ *
+ * @param bucket bucket index
+ * @return latency in nanoseconds
+ */
+static uint64_t latency_limit(int bucket) {
+    if (bucket < LATENCY_SUB)
+        return bucket;
+    int e = bucket / LATENCY_SUB + LATENCY_SUB_BITS - 1;
+    uint64_t step = (uint64_t)1 << (e - LATENCY_SUB_BITS);
+    return (uint64_t)(LATENCY_SUB + bucket % LATENCY_SUB) * step + step - 1;
+}
+
+/**
+ * Size class of a request: up to 16 bytes, then by factors of 4 up to 256K,
+ * then larger
+ *
+ * @param size requested bytes
+ * @return class index
+ */
+static int latency_class(size_t size) {
+    int bits = size <= 16 ? 4 : 64 - __builtin_clzll((unsigned long long)size - 1);
+    return MIN(bits <= 4 ? 0 : (bits - 3) / 2, MM_LATENCY_CLASSES - 1);
+}
+
+/**
+ * Count a call in its histogram
+ *
+ * @param op one of MM_OP_*
+ * @param size requested bytes
+ * @param start time the call started
+ */
+static void latency_record(int op, size_t size, uint64_t start) {
+    uint64_t *count = &latency[op][latency_class(size)][latency_bucket(latency_now() - start)];
+#ifdef MM_THREAD_SAFE
+    __atomic_fetch_add(count, 1, __ATOMIC_RELAXED);
+#else
+    (*count)++;
+#endif
+}
+
+/**
+ * Usable bytes of a payload, used as the size of a free
+ *
+ * @param ptr payload
+ * @return payload size
+ */
+static size_t usable_size(void *ptr) {
+    if (is_mapped(ptr))
+        return *(size_t *)((char *)ptr - ALIGNMENT) - ALIGNMENT;
+    SlabRun *run = slab_run_of(ptr);
+    if (run != NULL)
+        return run->slot_size;
+    return get_size((BlockHeader *)ptr - 1) - 4;
+}
+
+// the wrappers take the exported names, and call the bodies by theirs
+#undef mm_malloc
+#undef mm_calloc
+#undef mm_realloc
+#undef mm_free
+
+void *EXPORT_NAME(malloc)(size_t size) {
+    uint64_t start = latency_now();
+    void *ptr = BODY_NAME(malloc)(size);
+    latency_record(MM_OP_MALLOC, size, start);
+    return ptr;
+}
+
+void *EXPORT_NAME(calloc)(size_t count, size_t size) {
+    uint64_t start = latency_now();
+    void *ptr = BODY_NAME(calloc)(count, size);
+    latency_record(MM_OP_CALLOC, size != 0 && count > SIZE_MAX / size ? SIZE_MAX : count * size, start);
+    return ptr;
+}
+
+void *EXPORT_NAME(realloc)(void *ptr, size_t size) {
+    uint64_t start = latency_now();
+    void *new_ptr = BODY_NAME(realloc)(ptr, size);
+    latency_record(MM_OP_REALLOC, size, start);
+    return new_ptr;
+}
+
+void EXPORT_NAME(free)(void *ptr) {
+    if (ptr == NULL)
+        return;
+    size_t size = usable_size(ptr);  // before the block can be reused
+    uint64_t start = latency_now();
+    BODY_NAME(free)(ptr);
+    latency_record(MM_OP_FREE, size, start);
+}
+
+int mm_latency(int op, int size_class, LatencyHistogram *hist) {
+    if (op < 0 || op >= MM_NUM_OPS || size_class < -1 || size_class >= MM_LATENCY_CLASSES)
+        return -1;
+    memset(hist, 0, sizeof(*hist));
+    for (int c = 0; c < MM_LATENCY_CLASSES; c++) {
+        if (size_class >= 0 && c != size_class)
+            continue;
+        for (int b = 0; b < MM_LATENCY_BUCKETS; b++) {
+            unsigned long long count = __atomic_load_n(&latency[op][c][b], __ATOMIC_RELAXED);
+            hist->buckets[b] += count;
+            hist->count += count;
+        }
+    }
+    return 0;
+}
+
+long long mm_latency_percentile(const LatencyHistogram *hist, double p) {
+    if (hist->count == 0)
+        return -1;
+    // the bucket holding the ceil(p * count)-th smallest latency, the first
+    // for p = 0
+    double exact = p * hist->count;
+    unsigned long long rank = exact > 0 ? (unsigned long long)exact : 0;
+    if (rank < exact)
+        rank++;  // round up
+    rank = rank < 1 ? 1 : rank < hist->count ? rank : hist->count;
+    unsigned long long seen = 0;
+    for (int b = 0; b < MM_LATENCY_BUCKETS; b++) {
+        seen += hist->buckets[b];
+        if (seen >= rank)
+            return (long long)latency_limit(b);
+    }
+    return (long long)latency_limit(MM_LATENCY_BUCKETS - 1);
+}
+
+void mm_latency_dump(int fd) {
+    static const char *ops[] = { "malloc", "calloc", "realloc", "free" };
+    static const char *classes[] = { "16", "64", "256", "1K", "4K", "16K", "64K", "256K", "more" };
+    char line[160];
+    int len = snprintf(line, sizeof(line), "%-8s %5s %12s %10s %10s %10s %10s  (ns)\n",
+                       "op", "size", "count", "p50", "p99", "p99.9", "max");
+    if (write(fd, line, len) != len)
+        return;
+    for (int op = 0; op < MM_NUM_OPS; op++) {
+        for (int c = -1; c < MM_LATENCY_CLASSES; c++) {
+            LatencyHistogram hist;
+            mm_latency(op, c, &hist);
+            if (hist.count == 0)
+                continue;
+            len = snprintf(line, sizeof(line), "%-8s %5s %12llu %10lld %10lld %10lld %10lld\n",
+                           ops[op], c < 0 ? "all" : classes[c], hist.count,
+                           mm_latency_percentile(&hist, 0.5), mm_latency_percentile(&hist, 0.99),
+                           mm_latency_percentile(&hist, 0.999), mm_latency_percentile(&hist, 1));
+            if (write(fd, line, len) != len)
+                return;
+        }
+    }
+}
+#else
+int mm_latency(int op, int size_class, LatencyHistogram *hist) {
+    (void)op, (void)size_class, (void)hist;
+    return -1;  // not built with -DMM_LATENCY
+}
+
+long long mm_latency_percentile(const LatencyHistogram *hist, double p) {
+    (void)hist, (void)p;
+    return -1;
+}
+
+void mm_latency_dump(int fd) {
+    (void)fd;
+}
+#endif
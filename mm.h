@@ -3,9 +3,86 @@
 
 #include <stddef.h>  // size_t
 
+/* Options for mm_setopt, which must be called before mm_init */
+enum {
+    MM_OPT_POLICY,      // free block search policy, one of MM_POLICY_*
+    MM_OPT_TCACHE,      // blocks per thread cache bin before a flush, 0 = off
+    MM_OPT_ARENAS,      // number of arenas threads are spread over, 1 to 64
+    MM_OPT_TRIM_THRESHOLD, // free bytes at the heap top to return, 0 = never
+    MM_OPT_DECAY_MS,    // ms before the pages of a large free block are purged, -1 = never
+    MM_OPT_MMAP_THRESHOLD, // smallest request given its own mapping
+    MM_OPT_LATENCY_DUMP, // file descriptor the latency histograms are written to at exit, -1 = none
+};
+
+/* Free block search policies */
+enum {
+    MM_POLICY_SEGFIT,   // segregated fits (default)
+    MM_POLICY_TLSF,     // two-level segregated fit, O(1) malloc and free
+};
+
+/* Operations timed by the latency histograms */
+enum {
+    MM_OP_MALLOC,
+    MM_OP_CALLOC,
+    MM_OP_REALLOC,
+    MM_OP_FREE,
+    MM_NUM_OPS,
+};
+
+/* Request sizes up to 16, 64, 256, 1K, 4K, 16K, 64K, 256K bytes, and larger */
+#define MM_LATENCY_CLASSES 9
+#define MM_LATENCY_BUCKETS 160
+
+/* Calls by latency; bucket bounds are given by mm_latency_percentile */
+typedef struct {
+    unsigned long long count;
+    unsigned long long buckets[MM_LATENCY_BUCKETS];
+} LatencyHistogram;
+
+/* Heap statistics, see mm_stats */
+#define MM_STATS_BUCKETS 32
+
+typedef struct {
+    size_t heap_size;        // bytes obtained from memlib, mem_heapsize()
+    size_t mapped_bytes;     // bytes of the mappings of large requests
+    size_t mapped_count;     // number of those mappings
+    size_t allocated_bytes;  // heap blocks in use, headers included; slab runs
+                             // and blocks held by thread caches count as in use
+    size_t free_bytes;       // bytes of the free heap blocks
+    size_t free_blocks;      // number of free heap blocks
+    size_t free_histogram[MM_STATS_BUCKETS];  // free blocks of 2^i to 2^(i+1)-1 bytes
+    size_t largest_free;     // size of the largest free block; below the tree
+                             // of segfit, to within the range of its free list
+    /* Cumulative since mm_init: frees and shrinking reallocs take nothing
+     * off, so these describe the requests served, not the live heap */
+    size_t requested_total;  // payload bytes of all allocations, cache hits,
+                             // slots, mappings and reallocs included
+    size_t placed_total;     // bytes of the blocks, slots or mappings that served them
+    double placement_overhead;  // 1 - requested_total / placed_total
+    double external_fragmentation;  // 1 - largest_free / free_bytes
+} HeapStats;
+
+int   mm_setopt(int option, long value);
 int   mm_init(void);
 void *mm_malloc(size_t size);
+void *mm_calloc(size_t count, size_t size);
 void *mm_realloc(void *ptr, size_t size);
 void  mm_free(void *ptr);
+int   mm_stats(HeapStats *stats);
+
+/* Heap checker and walker, compiled out with -DNDEBUG; mm_check returns 0
+ * when the heap is consistent. Visitors must not call the allocator. */
+#ifndef NDEBUG
+int   mm_check(void);
+int   mm_heap_walk(int (*visit)(void *payload, size_t size, int allocated, void *arg), void *arg);
+#else
+#define mm_check() 0
+#define mm_heap_walk(visit, arg) 0
+#endif
+
+/* Latency histograms, recorded when built with -DMM_LATENCY */
+int       mm_latency(int op, int size_class, LatencyHistogram *hist);
+long long mm_latency_percentile(const LatencyHistogram *hist, double p);
+void      mm_latency_dump(int fd);
 
 #endif /* __MM_H__ */
@@ -0,0 +1,271 @@
+/*
+ * Recording layer around the public allocator functions.
+ *
+ * Compiled together with mm.c, both with -DMM_TRACE, every call made while a
+ * trace is open is appended to a buffer of the calling thread, which is
+ * written to the trace file in large chunks. Threads share no lock on the
+ * way: the order of the calls comes from a global sequence number, taken
+ * before a block is released and after one is returned, so that no record
+ * of a block getting reused sorts before the record of its release. The
+ * buffer of a thread is written out when it fills up, when the thread exits
+ * and when the trace is closed. With no trace open, a call costs one extra
+ * branch.
+ */
+#include "mm.h"
+#include "mm_trace.h"
+
+#include <fcntl.h>   // open
+#include <stdlib.h>  // atexit, calloc
+#include <string.h>  // memset, strcpy
+#include <time.h>    // clock_gettime -- record timestamps
+#include <unistd.h>  // write, close
+#ifdef MM_THREAD_SAFE
+#include <pthread.h> // pthread_mutex_t, pthread_key_t -- buffers of the threads
+#endif
+
+#ifdef MM_TRACE
+
+#define TRACE_BUFFER 1024  // records written at a time
+
+#ifdef MM_THREAD_SAFE
+typedef pthread_mutex_t TraceLock;
+#define TRACE_LOCK_INITIALIZER PTHREAD_MUTEX_INITIALIZER
+#define trace_lock_init(l) pthread_mutex_init(l, NULL)
+#define trace_lock(l)   pthread_mutex_lock(l)
+#define trace_unlock(l) pthread_mutex_unlock(l)
+#else
+typedef int TraceLock;
+#define TRACE_LOCK_INITIALIZER 0
+#define trace_lock_init(l) ((void)(l))
+#define trace_lock(l)   ((void)(l))
+#define trace_unlock(l) ((void)(l))
+#endif
+
+/*
+ * Records of one thread. Only the thread appends to it, its lock is only
+ * contended by mm_trace_close, which writes out the buffers of all threads.
+ */
+typedef struct TraceBuffer {
+    TraceLock lock;
+    int count;
+    uint32_t thread;           // number of the thread, from 0
+    struct TraceBuffer *prev;  // all buffers, for mm_trace_close
+    struct TraceBuffer *next;
+    TraceRecord records[TRACE_BUFFER];
+} TraceBuffer;
+
+/* Guards trace_buffers and the opening and closing of trace_fd */
+static TraceLock trace_mutex = TRACE_LOCK_INITIALIZER;
+
+static int trace_fd = -1;
+static struct timespec trace_start;
+static uint64_t trace_seq;      // next sequence number, unique across traces
+static uint32_t trace_threads;  // threads numbered so far
+static TraceBuffer *trace_buffers;
+static __thread TraceBuffer *trace_buffer;  // buffer of this thread
+
+/**
+ * Writes out the records of a buffer; its lock must be held
+ * @param buf - buffer to empty
+ * @param fd - trace file
+ */
+static void trace_flush(TraceBuffer *buf, int fd) {
+    const char *data = (const char *)buf->records;
+    size_t left = buf->count * sizeof(TraceRecord);
+    while (left > 0) {
+        ssize_t written = write(fd, data, left);
+        if (written <= 0)
+            break;  // the trace is cut short, the allocator goes on
+        data += written;
+        left -= written;
+    }
+    buf->count = 0;
+}
+
+#ifdef MM_THREAD_SAFE
+static pthread_key_t trace_key;
+static pthread_once_t trace_key_once = PTHREAD_ONCE_INIT;
+
+/**
+ * Writes out the buffer of an exiting thread and drops it
+ * @param arg - the buffer of the thread
+ */
+static void trace_exit(void *arg) {
+    TraceBuffer *buf = arg;
+    trace_lock(&trace_mutex);
+    if (trace_fd >= 0)
+        trace_flush(buf, trace_fd);
+    if (buf->prev != NULL)
+        buf->prev->next = buf->next;
+    else
+        trace_buffers = buf->next;
+    if (buf->next != NULL)
+        buf->next->prev = buf->prev;
+    trace_unlock(&trace_mutex);
+    free(buf);
+    trace_buffer = NULL;  // a later destructor may still allocate
+}
+
+static void trace_key_create(void) {
+    pthread_key_create(&trace_key, trace_exit);
+}
+#endif
+
+/**
+ * @return the buffer of this thread, created on its first record, or NULL
+ *         if there is no memory for it
+ */
+static TraceBuffer *thread_buffer(void) {
+    if (trace_buffer != NULL)
+        return trace_buffer;
+    TraceBuffer *buf = calloc(1, sizeof(TraceBuffer));
+    if (buf == NULL)
+        return NULL;  // the calls of the thread go unrecorded
+    trace_lock_init(&buf->lock);
+    buf->thread = __atomic_fetch_add(&trace_threads, 1, __ATOMIC_RELAXED);
+    trace_lock(&trace_mutex);
+    buf->next = trace_buffers;
+    if (trace_buffers != NULL)
+        trace_buffers->prev = buf;
+    trace_buffers = buf;
+    trace_unlock(&trace_mutex);
+#ifdef MM_THREAD_SAFE
+    pthread_once(&trace_key_once, trace_key_create);
+    pthread_setspecific(trace_key, buf);
+#endif
+    return trace_buffer = buf;
+}
+
+/**
+ * @return the next sequence number of the trace
+ */
+static uint64_t next_seq(void) {
+    return __atomic_fetch_add(&trace_seq, 1, __ATOMIC_RELAXED);
+}
+
+/**
+ * Appends a record to the buffer of this thread
+ * @param op - one of TRACE_*
+ * @param size - bytes requested
+ * @param ptr - block passed in, or NULL
+ * @param result - block returned, or NULL
+ * @param seq - sequence number taken when ptr was released, or the call
+ *        took effect; realloc takes another one for its result here
+ */
+static void trace_append(int op, uint64_t size, void *ptr, void *result, uint64_t seq) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    TraceBuffer *buf = thread_buffer();
+    if (buf == NULL)
+        return;
+
+    trace_lock(&buf->lock);
+    int fd = __atomic_load_n(&trace_fd, __ATOMIC_ACQUIRE);
+    if (fd >= 0) {  // else the trace was closed during the call
+        TraceRecord *rec = &buf->records[buf->count];
+        rec->seq = seq;
+        rec->new_seq = op == TRACE_REALLOC ? next_seq() : seq;
+        rec->time = (uint64_t)(now.tv_sec - trace_start.tv_sec) * 1000000000 +
+                    now.tv_nsec - trace_start.tv_nsec;
+        rec->size = size;
+        rec->id = (uintptr_t)ptr;
+        rec->new_id = (uintptr_t)result;
+        rec->thread = buf->thread;
+        rec->op = op;
+        if (++buf->count == TRACE_BUFFER)
+            trace_flush(buf, fd);  // mm_trace_close waits for the buffer lock
+    }
+    trace_unlock(&buf->lock);
+}
+
+/**
+ * @return whether calls are being recorded
+ */
+static int tracing(void) {
+    return __atomic_load_n(&trace_fd, __ATOMIC_ACQUIRE) >= 0;
+}
+
+/**
+ * Starts recording calls to a new trace file, replacing any open trace
+ * @param path - file to create
+ * @return 0 on success, -1 if the file cannot be written
+ */
+int mm_trace_open(const char *path) {
+    static int registered;
+    mm_trace_close();
+    int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0)
+        return -1;
+
+    TraceHeader header;
+    memset(&header, 0, sizeof(header));
+    strcpy(header.magic, TRACE_MAGIC);
+    header.version = TRACE_VERSION;
+    header.record_size = sizeof(TraceRecord);
+    if (write(fd, &header, sizeof(header)) != sizeof(header)) {
+        close(fd);
+        return -1;
+    }
+
+    trace_lock(&trace_mutex);
+    if (!registered)
+        registered = atexit(mm_trace_close) == 0;  // flush the last records
+    clock_gettime(CLOCK_MONOTONIC, &trace_start);
+    __atomic_store_n(&trace_fd, fd, __ATOMIC_RELEASE);
+    trace_unlock(&trace_mutex);
+    return 0;
+}
+
+/**
+ * Stops recording and writes out the records of all threads
+ */
+void mm_trace_close(void) {
+    trace_lock(&trace_mutex);
+    int fd = trace_fd;
+    if (fd >= 0) {
+        // calls that see the trace closed from here on record nothing
+        __atomic_store_n(&trace_fd, -1, __ATOMIC_RELEASE);
+        for (TraceBuffer *buf = trace_buffers; buf != NULL; buf = buf->next) {
+            trace_lock(&buf->lock);
+            trace_flush(buf, fd);
+            trace_unlock(&buf->lock);
+        }
+        close(fd);
+    }
+    trace_unlock(&trace_mutex);
+}
+
+void *mm_malloc(size_t size) {
+    void *result = mm_untraced_malloc(size);
+    if (tracing())
+        trace_append(TRACE_MALLOC, size, NULL, result, next_seq());
+    return result;
+}
+
+void *mm_calloc(size_t count, size_t size) {
+    void *result = mm_untraced_calloc(count, size);
+    if (tracing()) {
+        uint64_t total = size != 0 && count > SIZE_MAX / size ? UINT64_MAX : count * size;
+        trace_append(TRACE_CALLOC, total, NULL, result, next_seq());
+    }
+    return result;
+}
+
+void *mm_realloc(void *ptr, size_t size) {
+    if (!tracing())
+        return mm_untraced_realloc(ptr, size);
+    // the old block is released during the call and the new one returned at
+    // its end: each gets a sequence number of its own
+    uint64_t seq = next_seq();
+    void *result = mm_untraced_realloc(ptr, size);
+    trace_append(TRACE_REALLOC, size, ptr, result, seq);
+    return result;
+}
+
+void mm_free(void *ptr) {
+    if (ptr != NULL && tracing())
+        trace_append(TRACE_FREE, 0, ptr, NULL, next_seq());
+    mm_untraced_free(ptr);
+}
+
+#endif /* MM_TRACE */
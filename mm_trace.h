@@ -0,0 +1,58 @@
+#ifndef __MM_TRACE_H__
+#define __MM_TRACE_H__
+
+#include <stddef.h>  // size_t
+#include <stdint.h>  // uint32_t, uint64_t
+
+/*
+ * Binary trace of allocator calls: a TraceHeader, then one TraceRecord per
+ * call. Threads write their records in batches, so the file is not in call
+ * order: the sequence numbers of the records give it. Fields are in host
+ * byte order.
+ */
+#define TRACE_MAGIC "MMTRACE"
+#define TRACE_VERSION 2
+
+/* Operations of a trace record */
+enum {
+    TRACE_MALLOC,   // new_id = mm_malloc(size)
+    TRACE_CALLOC,   // new_id = mm_calloc(1, size)
+    TRACE_REALLOC,  // new_id = mm_realloc(id, size)
+    TRACE_FREE,     // mm_free(id)
+};
+
+typedef struct {
+    char     magic[8];     // TRACE_MAGIC
+    uint32_t version;      // TRACE_VERSION
+    uint32_t record_size;  // sizeof(TraceRecord)
+} TraceHeader;
+
+/*
+ * Ids name blocks: any value that is unique among the live blocks, 0 standing
+ * for NULL. The recorder uses the block addresses.
+ *
+ * Sequence numbers are unique across the trace. A call releases id at seq,
+ * taken before the block can be reused, and holds new_id from new_seq, taken
+ * once the block is returned; they differ only for realloc, which does both.
+ */
+typedef struct {
+    uint64_t seq;     // when id was released, or the call took effect
+    uint64_t new_seq; // when new_id was returned, seq if the call returns none
+    uint64_t time;    // ns since the trace was opened
+    uint64_t size;    // bytes requested, 0 for free; UINT64_MAX if calloc overflowed
+    uint64_t id;      // block passed in by free and realloc, else 0
+    uint64_t new_id;  // block returned, 0 for free or on failure
+    uint32_t thread;  // calling thread, numbered from 0 in order of first call
+    uint32_t op;      // one of TRACE_*
+} TraceRecord;
+
+int  mm_trace_open(const char *path);
+void mm_trace_close(void);
+
+/* Built with -DMM_TRACE, mm.c defines the public functions under these names */
+void *mm_untraced_malloc(size_t size);
+void *mm_untraced_calloc(size_t count, size_t size);
+void *mm_untraced_realloc(void *ptr, size_t size);
+void  mm_untraced_free(void *ptr);
+
+#endif /* __MM_TRACE_H__ */
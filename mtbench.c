@@ -0,0 +1,222 @@
+/*
+ * mtbench -- multi-threaded scaling benchmark for the allocator.
+ *
+ * Runs the same random malloc/free workload with 1, 2, ... N threads and
+ * prints the throughput of each run, so that lock contention shows up as
+ * speedup falling behind the thread count. Each thread count runs twice: on a
+ * single locked heap, and with one arena per thread. There are two workloads:
+ *  - local: each thread frees its own blocks;
+ *  - remote: each thread hands the blocks it allocates to the next thread,
+ *    which frees them: with one arena per thread, every free goes back to
+ *    the arena of another thread (with one thread, it is its own next one).
+ * Sizes are drawn up to max_size, 4096 by default: most requests are then too
+ * large for the slab runs and the thread caches, and go to the locked heap.
+ *
+ * Build with the thread-safe allocator:
+ *     cc -O2 -DMM_THREAD_SAFE mtbench.c mm.c memlib.c -o mtbench -lpthread
+ * Usage:
+ *     ./mtbench [max_threads] [ops_per_thread] [max_size] [local|remote]
+ */
+#include "mm.h"
+#include "memlib.h"
+
+#include <pthread.h> // pthread_create, pthread_join
+#include <stdio.h>   // printf, fprintf
+#include <stdlib.h>  // atoi, exit
+#include <string.h>  // memset
+#include <time.h>    // clock_gettime
+#include <unistd.h>  // sysconf
+
+#define SLOTS 512  // live blocks held by each thread
+#define RING 1024  // blocks in flight from a thread to the next one
+#define MIN(x, y) ((x) > (y) ? (y) : (x))
+
+static int ops_per_thread = 1000000;
+static int max_size = 4096;
+static int num_threads;  // threads of the current run
+
+/*
+ * Blocks handed from a thread to the next one: a ring with one producer and
+ * one consumer, with the two ends on cache lines of their own.
+ */
+typedef struct {
+    void *blocks[RING];
+    unsigned head __attribute__((aligned(64)));  // next block to take
+    unsigned tail __attribute__((aligned(64)));  // next free entry
+} Ring;
+
+static Ring rings[256];  // ring of each thread, filled by the previous one
+
+/**
+ * Small xorshift generator, so threads do not share rand() state
+ */
+static unsigned next_random(unsigned *state) {
+    unsigned x = *state;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    return *state = x;
+}
+
+/**
+ * Allocates and frees random sizes in random slots, touching each block
+ * @param arg - thread number, used as the random seed
+ * @return NULL, or (void *)1 when the allocator ran out of memory
+ */
+static void *local_worker(void *arg) {
+    unsigned seed = 2463534242u + (unsigned)(size_t)arg * 7919;
+    void *slots[SLOTS] = { 0 };
+    void *result = NULL;
+
+    for (int i = 0; i < ops_per_thread; i++) {
+        int k = next_random(&seed) % SLOTS;
+        if (slots[k] != NULL) {
+            mm_free(slots[k]);
+            slots[k] = NULL;
+        } else {
+            size_t size = 1 + next_random(&seed) % max_size;
+            slots[k] = mm_malloc(size);
+            if (slots[k] == NULL) {
+                result = (void *)1;
+                break;
+            }
+            memset(slots[k], i, size);
+        }
+    }
+    for (int k = 0; k < SLOTS; k++)
+        mm_free(slots[k]);
+    return result;
+}
+
+/**
+ * Hands a block to the consumer of a ring
+ * @return 0 if the ring is full
+ */
+static int ring_put(Ring *ring, void *ptr) {
+    unsigned tail = ring->tail;
+    if (tail - __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE) == RING)
+        return 0;
+    ring->blocks[tail % RING] = ptr;
+    __atomic_store_n(&ring->tail, tail + 1, __ATOMIC_RELEASE);
+    return 1;
+}
+
+/**
+ * Takes a block from the producer of a ring
+ * @return the block, or NULL if the ring is empty
+ */
+static void *ring_take(Ring *ring) {
+    unsigned head = ring->head;
+    if (head == __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE))
+        return NULL;
+    void *ptr = ring->blocks[head % RING];
+    __atomic_store_n(&ring->head, head + 1, __ATOMIC_RELEASE);
+    return ptr;
+}
+
+/**
+ * Allocates random sizes and hands them to the next thread, freeing the
+ * blocks handed by the previous one; a block finding the ring full is freed
+ * by its own thread
+ * @param arg - thread number, used as the random seed
+ * @return NULL, or (void *)1 when the allocator ran out of memory
+ */
+static void *remote_worker(void *arg) {
+    int t = (int)(size_t)arg;
+    unsigned seed = 2463534242u + (unsigned)t * 7919;
+    Ring *next = &rings[(t + 1) % num_threads];
+
+    for (int i = 0; i < ops_per_thread; i += 2) {
+        mm_free(ring_take(&rings[t]));
+        size_t size = 1 + next_random(&seed) % max_size;
+        void *ptr = mm_malloc(size);
+        if (ptr == NULL)
+            return (void *)1;
+        memset(ptr, i, size);
+        if (!ring_put(next, ptr))
+            mm_free(ptr);
+    }
+    return NULL;
+}
+
+/**
+ * Runs a workload on a fresh heap with the given number of threads
+ * @param worker - local_worker or remote_worker
+ * @param threads - number of worker threads
+ * @param arenas - number of arenas the threads are spread over
+ * @return elapsed wall-clock seconds, or -1 on failure
+ */
+static double run(void *(*worker)(void *), int threads, int arenas) {
+    pthread_t tids[threads];
+    struct timespec start, end;
+    int failed = 0;
+
+    mem_reset_brk();
+    if (mm_setopt(MM_OPT_ARENAS, arenas) < 0 || mm_init() < 0)
+        return -1;
+    num_threads = threads;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (int t = 0; t < threads; t++)
+        pthread_create(&tids[t], NULL, worker, (void *)(size_t)t);
+    for (int t = 0; t < threads; t++) {
+        void *result;
+        pthread_join(tids[t], &result);
+        failed |= result != NULL;
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    for (int t = 0; t < threads; t++) {
+        void *ptr;
+        while ((ptr = ring_take(&rings[t])) != NULL)
+            mm_free(ptr);  // blocks the last operations left in flight
+    }
+    if (failed)
+        return -1;
+    return (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+}
+
+int main(int argc, char **argv) {
+    int max_threads = sysconf(_SC_NPROCESSORS_ONLN);
+    const char *workload = NULL;  // both
+    if (argc > 1)
+        max_threads = atoi(argv[1]);
+    if (argc > 2)
+        ops_per_thread = atoi(argv[2]);
+    if (argc > 3)
+        max_size = atoi(argv[3]);
+    if (argc > 4)
+        workload = argv[4];
+    if (max_threads < 1 || max_threads > 256 || ops_per_thread < 1 || max_size < 1 ||
+            (workload != NULL && strcmp(workload, "local") != 0 && strcmp(workload, "remote") != 0)) {
+        fprintf(stderr, "usage: %s [max_threads] [ops_per_thread] [max_size] [local|remote]\n",
+                argv[0]);
+        exit(1);
+    }
+
+    mem_init();
+    for (int w = 0; w < 2; w++) {
+        const char *name = w == 0 ? "local" : "remote";
+        if (workload != NULL && strcmp(workload, name) != 0)
+            continue;
+        printf("%-7s  ---- 1 arena ----  --- N arenas ----\n", name);
+        printf("threads   Mops/s  speedup   Mops/s  speedup\n");
+        double base = 0;
+        for (int threads = 1; threads <= max_threads; threads++) {
+            double mops[2];
+            for (int i = 0; i < 2; i++) {
+                double secs = run(w == 0 ? local_worker : remote_worker, threads,
+                                  i == 0 ? 1 : MIN(threads, 64));
+                if (secs < 0) {
+                    fprintf(stderr, "%s run with %d threads failed\n", name, threads);
+                    exit(1);
+                }
+                mops[i] = (double)threads * ops_per_thread / secs / 1e6;
+            }
+            if (threads == 1)
+                base = mops[0];
+            printf("%7d %8.2f %8.2f %8.2f %8.2f\n", threads,
+                   mops[0], mops[0] / base, mops[1], mops[1] / base);
+        }
+    }
+    mem_deinit();
+    return 0;
+}
@@ -0,0 +1,215 @@
+/*
+ * tlbbench -- compares the heap backed by base pages and by huge pages.
+ *
+ * Fills a large heap with randomly sized blocks, frees every other one so the
+ * free lists are spread over the whole heap, then runs random malloc/free
+ * churn on it. Each page mode runs the same workload on a fresh heap, and the
+ * data TLB read misses are counted with perf_event_open where the kernel
+ * allows it (see /proc/sys/kernel/perf_event_paranoid). A hugetlb run
+ * without reserved pages (vm.nr_hugepages) falls back to THP.
+ *
+ * Every mode runs twice: with the default dirty page decay, whose purges must
+ * not break up the huge pages, and with decay off.
+ *
+ * To compare the page modes on recorded or generated traces instead, replay
+ * them with mdriver -H normal|thp|hugetlb.
+ *
+ * Build:
+ *     cc -O2 tlbbench.c mm.c memlib.c -o tlbbench
+ * Usage:
+ *     ./tlbbench [heap_mb] [ops]
+ */
+#include "mm.h"
+#include "memlib.h"
+
+#include <linux/perf_event.h> // perf_event_attr
+#include <stdint.h>  // uint64_t
+#include <stdio.h>   // printf, fprintf
+#include <stdlib.h>  // atoi, exit, malloc
+#include <string.h>  // memset
+#include <sys/ioctl.h>   // PERF_EVENT_IOC_*
+#include <sys/syscall.h> // SYS_perf_event_open
+#include <time.h>    // clock_gettime
+#include <unistd.h>  // syscall, read, close
+
+#define MAX_SIZE 4096  // largest block of the workload
+
+static const char *mode_names[] = { "normal", "thp", "hugetlb" };
+
+/**
+ * Small xorshift generator, so every mode sees the same sequence
+ */
+static unsigned next_random(unsigned *state) {
+    unsigned x = *state;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    return *state = x;
+}
+
+/**
+ * Opens a counter of the data TLB read misses of this thread
+ * @return the counter file descriptor, or -1 if it is not available
+ */
+static int open_tlb_counter(void) {
+    struct perf_event_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = PERF_TYPE_HW_CACHE;
+    attr.config = PERF_COUNT_HW_CACHE_DTLB |
+                  (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+                  (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+    attr.disabled = 1;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    return (int)syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+}
+
+/**
+ * Counts the resident heap memory backed by transparent huge pages
+ * @return kilobytes of AnonHugePages in the heap mapping, or 0
+ */
+static long heap_huge_kb(void) {
+    FILE *f = fopen("/proc/self/smaps", "r");
+    char line[256];
+    long kb = 0;
+    int in_heap = 0;
+
+    if (f == NULL)
+        return 0;
+    while (fgets(line, sizeof(line), f) != NULL) {
+        unsigned long lo, hi;
+        if (sscanf(line, "%lx-%lx ", &lo, &hi) == 2)
+            in_heap = lo <= (uintptr_t)mem_heap_lo() && (uintptr_t)mem_heap_lo() < hi;
+        else if (in_heap && sscanf(line, "AnonHugePages: %ld kB", &lo) == 1)
+            kb += (long)lo;
+    }
+    fclose(f);
+    return kb;
+}
+
+/**
+ * Fills the heap with blocks, then frees every other one to fragment it
+ * @param slots - receives the blocks
+ * @param seed - state of the random generator
+ * @return 0 on success, -1 when the allocator ran out of memory
+ */
+static int fill(void **slots, int blocks, unsigned *seed) {
+    for (int k = 0; k < blocks; k++) {
+        size_t size = 16 + next_random(seed) % MAX_SIZE;
+        if ((slots[k] = mm_malloc(size)) == NULL)
+            return -1;
+        memset(slots[k], k, size);
+    }
+    for (int k = 0; k < blocks; k += 2) {
+        mm_free(slots[k]);
+        slots[k] = NULL;
+    }
+    return 0;
+}
+
+/**
+ * Runs the churn phase on a filled heap and reports it
+ * @param mode - page mode requested, for the report
+ * @param decay - name of the decay setting, for the report
+ * @param slots - blocks of the heap, NULL where freed
+ * @param seed - state of the random generator
+ * @return 0 on success, -1 when the allocator ran out of memory
+ */
+static int churn(int mode, const char *decay, void **slots, int blocks, int ops, unsigned *seed) {
+    struct timespec start, end;
+    uint64_t misses = 0;
+    int result = 0;
+
+    int fd = open_tlb_counter();
+    if (fd >= 0) {
+        ioctl(fd, PERF_EVENT_IOC_RESET, 0);
+        ioctl(fd, PERF_EVENT_IOC_ENABLE, 0);
+    }
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (int i = 0; i < ops; i++) {
+        int k = next_random(seed) % blocks;
+        if (slots[k] != NULL) {
+            mm_free(slots[k]);
+            slots[k] = NULL;
+        } else {
+            size_t size = 16 + next_random(seed) % MAX_SIZE;
+            if ((slots[k] = mm_malloc(size)) == NULL) {
+                result = -1;
+                break;
+            }
+            *(char *)slots[k] = (char)i;
+        }
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    if (fd >= 0) {
+        ioctl(fd, PERF_EVENT_IOC_DISABLE, 0);
+        if (read(fd, &misses, sizeof(misses)) != sizeof(misses))
+            misses = 0;
+        close(fd);
+    }
+
+    if (result == 0) {
+        double secs = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+        char name[32];
+        snprintf(name, sizeof(name), mode == mem_hugepages() ? "%s" : "%s->%s",
+                 mode_names[mode], mode_names[mem_hugepages()]);
+        printf("%-16s %-8s %8.3f %9.2f ", name, decay, secs, ops / secs / 1e6);
+        if (fd >= 0)
+            printf("%14llu ", (unsigned long long)misses);
+        else
+            printf("%14s ", "n/a");
+        printf("%10ld\n", heap_huge_kb() / 1024);
+    }
+    return result;
+}
+
+/**
+ * Runs the workload on a fresh heap backed by the given pages
+ * @param mode - MEM_PAGES_NORMAL, MEM_PAGES_THP or MEM_PAGES_HUGETLB
+ * @param decay - name of the decay setting, for the report
+ * @param blocks - number of live blocks that fill the heap
+ * @param ops - malloc/free operations of the churn phase
+ * @return 0 on success, -1 when the allocator ran out of memory
+ */
+static int run(int mode, const char *decay, int blocks, int ops) {
+    void **slots = calloc(blocks, sizeof(void *));
+    unsigned seed = 2463534242u;
+
+    mem_set_hugepages(mode);
+    mem_init();
+    int result = slots == NULL || mm_init() < 0 ? -1 : fill(slots, blocks, &seed);
+    if (result == 0)
+        result = churn(mode, decay, slots, blocks, ops, &seed);
+    free(slots);
+    mem_deinit();  // the heap goes with its blocks, whatever happened
+    return result;
+}
+
+int main(int argc, char **argv) {
+    int heap_mb = 1024;
+    int ops = 10000000;
+    if (argc > 1)
+        heap_mb = atoi(argv[1]);
+    if (argc > 2)
+        ops = atoi(argv[2]);
+    if (heap_mb < 1 || ops < 1) {
+        fprintf(stderr, "usage: %s [heap_mb] [ops]\n", argv[0]);
+        exit(1);
+    }
+
+    // blocks average about MAX_SIZE / 2 bytes
+    int blocks = (int)((size_t)heap_mb * 1024 * 1024 / (MAX_SIZE / 2 + 16));
+    printf("mode             decay        secs   Mops/s  dTLB misses     THP MB\n");
+    for (int decay = 1; decay >= 0; decay--) {
+        if (!decay)
+            mm_setopt(MM_OPT_DECAY_MS, -1);  // the default runs come first
+        for (int mode = MEM_PAGES_NORMAL; mode <= MEM_PAGES_HUGETLB; mode++) {
+            if (run(mode, decay ? "default" : "off", blocks, ops) < 0) {
+                fprintf(stderr, "%s run failed\n", mode_names[mode]);
+                exit(1);
+            }
+        }
+    }
+    return 0;
+}